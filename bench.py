@@ -7,13 +7,25 @@ import os
 from pathlib import Path
 import signal
 import subprocess
-from typing import List, Tuple
+import time
+from typing import Dict, List, Optional, Tuple
 import numpy as np
 import scipy.stats
 
 # 10 min timeout
 TIMEOUT = 600
 
+# Benchmarks under bench/, each prints its run time in seconds and may
+# follow it with an RSS in KB (peak or final, per benchmark). Further lines
+# time scenarios: "<scenario> <threads> <operations> <seconds>", give call
+# latencies: "latency <call> <count> <p50 ns> <p99 ns> <max ns>", or count
+# misses of a cache or TLB: "<counter> <scenario> <misses>"
+BENCHMARKS = ["glibc-malloc-bench-simple", "producer-consumer", "large-fragment", "burst-rss", "batch",
+              "thread-scaling", "region", "thp", "freelist"]
+
+# Miss counters benchmarks may report, by the name they print them with
+MISS_COUNTERS = {"dtlb": "dTLB misses", "l1d": "L1d misses", "llc": "LLC misses"}
+
 # Stats for tests
 TOTAL_RUNS = 0
 TOTAL_FAILS = 0
@@ -33,6 +45,12 @@ def parse_args():
                         help="allocator name, default to \"mymalloc\"")
     parser.add_argument("-i", "--invocations", type=int, default=10,
                         help="number of invocations of the benchmark")
+    parser.add_argument("-p", "--program", type=str,
+                        help="shell command of an unmodified program to time "
+                             "with libc's malloc and with the allocator preloaded")
+    parser.add_argument("-t", "--trace", type=str,
+                        help="allocation trace recorded with MYMALLOC_TRACE to "
+                             "replay instead of the benchmarks")
     return parser.parse_args()
 
 
@@ -136,12 +154,12 @@ def check_test(test: str, output: bytes, exit_code: SubprocessExit, path: Path):
             "UTF-8"), "exit_code": exit_code})
 
 
-def run_benchmark_once(path: str, cwd: Path, i: int) -> Tuple[bytes, float, SubprocessExit]:
+def run_benchmark_once(cmd: List[str], cwd: Path, i: int) -> Tuple[bytes, float, Optional[int], Dict[Tuple[str, int], float], Dict[str, Tuple[int, int, int]], Dict[Tuple[str, str], float], SubprocessExit]:
     try:
-        print(f"{bcolors.OKCYAN}Running {bcolors.BOLD}{get_test_name(path)} #{i} {bcolors.ENDC}",
+        print(f"{bcolors.OKCYAN}Running {bcolors.BOLD}{get_test_name(cmd[0])} #{i} {bcolors.ENDC}",
               end='', flush=True)
         p = subprocess.run(
-            [path],
+            cmd,
             check=True,
             env=os.environ.copy(),
             stdout=subprocess.PIPE,
@@ -149,19 +167,81 @@ def run_benchmark_once(path: str, cwd: Path, i: int) -> Tuple[bytes, float, Subp
             timeout=TIMEOUT,
             cwd=cwd
         )
-        time = float(p.stdout.decode("utf-8").strip())
+        # Run time in seconds, optionally followed by an RSS in KB, then the
+        # operations per second of each scenario and thread count, call
+        # latencies and cache or TLB misses
+        lines = p.stdout.decode("utf-8").splitlines()
+        fields = lines[0].split()
+        time = float(fields[0])
+        rss = int(fields[1]) if len(fields) > 1 else None
+        rates = {}
+        latencies = {}
+        misses = {}
+        for line in lines[1:]:
+            fields = line.split()
+            if fields[0] == "latency":
+                call, count, p50, p99, worst = fields[1:]
+                latencies[call] = (int(p50), int(p99), int(worst))
+                continue
+            if fields[0] in MISS_COUNTERS:
+                misses[(fields[0], fields[1])] = float(fields[2])
+                continue
+            scenario, threads, ops, seconds = fields
+            if float(seconds) > 0:
+                rates[(scenario, int(threads))] = int(ops) / float(seconds)
         print(f"{bcolors.OKGREEN}OK ({time:.3f}s){bcolors.ENDC}", flush=True)
-        return p.stdout, time, SubprocessExit.Normal
+        return p.stdout, time, rss, rates, latencies, misses, SubprocessExit.Normal
     except subprocess.CalledProcessError as e:
         if -e.returncode in signal.valid_signals():
             exit_signal = bytearray(e.stdout)
             exit_signal.extend(
                 bytes(f"{signal.strsignal(-e.returncode)}", "UTF-8"))
             e.stdout = bytes(exit_signal)
-        return e.stdout, -1, SubprocessExit.Error
+        return e.stdout, -1, None, {}, {}, {}, SubprocessExit.Error
     except subprocess.TimeoutExpired as e:
         out = f"Timed out after {TIMEOUT}s"
-        return bytes(out, "UTF-8"), -1, SubprocessExit.Timeout
+        return bytes(out, "UTF-8"), -1, None, {}, {}, {}, SubprocessExit.Timeout
+
+
+def run_program_once(cmd: str, cwd: Path, i: int, env: dict) -> Tuple[bytes, float, SubprocessExit]:
+    try:
+        print(f"{bcolors.OKCYAN}Running {bcolors.BOLD}#{i} {bcolors.ENDC}", end='', flush=True)
+        # The program reports nothing, so it is timed from outside
+        start = time.perf_counter()
+        p = subprocess.run(
+            ["/bin/sh", "-c", cmd],
+            check=True,
+            env=env,
+            stdout=subprocess.DEVNULL,
+            stderr=subprocess.PIPE,
+            timeout=TIMEOUT,
+            cwd=cwd
+        )
+        elapsed = time.perf_counter() - start
+        print(f"{bcolors.OKGREEN}OK ({elapsed:.3f}s){bcolors.ENDC}", flush=True)
+        return p.stderr, elapsed, SubprocessExit.Normal
+    except subprocess.CalledProcessError as e:
+        print(f"{bcolors.FAIL}FAIL{bcolors.ENDC}: {e.stderr.decode('UTF-8')}", flush=True)
+        return e.stderr, -1, SubprocessExit.Error
+    except subprocess.TimeoutExpired as e:
+        print(f"{bcolors.WARNING}TIMEOUT{bcolors.ENDC}", flush=True)
+        return bytes(f"Timed out after {TIMEOUT}s", "UTF-8"), -1, SubprocessExit.Timeout
+
+
+def run_program(cmd: str, invocations: int, cwd: Path, preload: Path):
+    # A/B the same command, libc's malloc first
+    for name, extra in [("libc", {}), (preload.name, {"LD_PRELOAD": str(preload)})]:
+        print(f"{bcolors.OKCYAN}Start {bcolors.BOLD}{name}{bcolors.ENDC}{bcolors.OKCYAN} with {bcolors.BOLD}{invocations}{bcolors.ENDC}{bcolors.OKCYAN} invocations.{bcolors.ENDC}", flush=True)
+        env = os.environ.copy()
+        env.update(extra)
+        times = []
+        for i in range(invocations):
+            _, elapsed, exit_code = run_program_once(cmd, cwd, i, env)
+            if exit_code == SubprocessExit.Normal:
+                times.append(elapsed)
+        if len(times) > 0:
+            mean, err = calc_mean_with_ci(times)
+            print(f"{bcolors.OKGREEN}Average Time: {bcolors.BOLD}{mean:.3f}s ±{err:.3f}{bcolors.ENDC}", flush=True)
 
 
 def calc_mean_with_ci(x: List[float], confidence=0.95) -> Tuple[float, float]:
@@ -174,13 +254,25 @@ def calc_mean_with_ci(x: List[float], confidence=0.95) -> Tuple[float, float]:
     return (m, h)
 
 
-def run_benchmark(path: str, invocations: int, cwd: Path):
+def run_benchmark(cmd: List[str], invocations: int, cwd: Path):
     print(f"{bcolors.OKCYAN}Start benchmark with {bcolors.ENDC}{bcolors.OKCYAN}{bcolors.BOLD}{invocations}{bcolors.ENDC}{bcolors.OKCYAN} invocations.{bcolors.ENDC}", flush=True)
     times = []
+    rsses = []
+    rates = {}
+    latencies = {}
+    misses = {}
     for i in range(invocations):
-        out, time, exit_code = run_benchmark_once(path, cwd, i)
+        out, time, rss, run_rates, run_latencies, run_misses, exit_code = run_benchmark_once(cmd, cwd, i)
         if exit_code == SubprocessExit.Normal:
             times.append(time)
+            if rss is not None:
+                rsses.append(rss)
+            for key, rate in run_rates.items():
+                rates.setdefault(key, []).append(rate)
+            for call, latency in run_latencies.items():
+                latencies.setdefault(call, []).append(latency)
+            for key, count in run_misses.items():
+                misses.setdefault(key, []).append(count)
         elif exit_code == SubprocessExit.Error:
             print(f"{bcolors.FAIL}FAIL{bcolors.ENDC}", flush=True)
         else:
@@ -194,6 +286,20 @@ def run_benchmark(path: str, invocations: int, cwd: Path):
             f"{bcolors.OKGREEN}Time: {bcolors.BOLD}{mean:.3f}s{bcolors.ENDC}", flush=True)
     else:
         print(f"{bcolors.OKGREEN}Average Time: {bcolors.BOLD}{mean:.3f}s ±{err:.3f}{bcolors.ENDC}", flush=True)
+    if len(rsses) > 0:
+        rss_mean, rss_err = calc_mean_with_ci(rsses)
+        print(f"{bcolors.OKGREEN}RSS: {bcolors.BOLD}{rss_mean:.0f}KB ±{rss_err:.0f}{bcolors.ENDC}", flush=True)
+    # Scenarios in the order the benchmark printed them
+    for (scenario, threads), values in rates.items():
+        rate_mean, rate_err = calc_mean_with_ci(values)
+        print(f"{bcolors.OKGREEN}{scenario:<28} {threads:>3} threads: {bcolors.BOLD}{rate_mean:>14,.0f} ops/s ±{rate_err:,.0f}{bcolors.ENDC}", flush=True)
+    # Percentiles of each run, averaged
+    for call, values in latencies.items():
+        p50, p99, worst = (np.mean([v[i] for v in values]) for i in range(3))
+        print(f"{bcolors.OKGREEN}{call:<28} latency: {bcolors.BOLD}p50 {p50:,.0f}ns p99 {p99:,.0f}ns max {worst:,.0f}ns{bcolors.ENDC}", flush=True)
+    for (counter, scenario), values in misses.items():
+        miss_mean, miss_err = calc_mean_with_ci(values)
+        print(f"{bcolors.OKGREEN}{scenario:<28} {MISS_COUNTERS[counter]}: {bcolors.BOLD}{miss_mean:>14,.2f} ±{miss_err:,.2f}{bcolors.ENDC}", flush=True)
 
 
 def main():
@@ -209,13 +315,24 @@ def main():
     build_cmd += "RELEASE=1 "
     output, exit_code = make(build_cmd, script_path)
     check_make(build_cmd, output, exit_code)
-    # Build benchmarks
-    output, exit_code = make(
-        f"bench/glibc-malloc-bench-simple " + build_cmd, script_path)
-    check_make(f"tests/glibc-malloc-bench-simple", output, exit_code)
-    # Run
-    run_benchmark(
-        f"{script_path}/bench/glibc-malloc-bench-simple", args.invocations, script_path)
+    if args.program is not None:
+        malloc = args.malloc if args.malloc is not None else "mymalloc"
+        run_program(args.program, args.invocations, Path.cwd(),
+                    script_path / "out" / f"lib{malloc}_preload.so")
+        return
+    if args.trace is not None:
+        output, exit_code = make("bench/replay " + build_cmd, script_path)
+        check_make("bench/replay", output, exit_code)
+        run_benchmark([f"{script_path}/bench/replay", os.path.abspath(args.trace)],
+                      args.invocations, script_path)
+        return
+    for bench in BENCHMARKS:
+        # Build benchmark
+        output, exit_code = make(f"bench/{bench} " + build_cmd, script_path)
+        check_make(f"bench/{bench}", output, exit_code)
+        # Run
+        run_benchmark([f"{script_path}/bench/{bench}"],
+                      args.invocations, script_path)
 
 
 class bcolors:
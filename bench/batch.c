@@ -0,0 +1,67 @@
+/* Batch allocation benchmark, after the mallocing_loop/freeing_loop pattern
+   of tests/testing.h: rounds of same-size objects, for slab and block
+   sizes, once taken and handed back with my_malloc/my_free per object and
+   once with my_malloc_batch and my_free_batch.  Prints the run time in
+   seconds and the peak RSS in KB, then "<scenario> 1 <objects> <seconds>"
+   for each.  */
+
+#include "../tests/testing.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#define NALLOCS 500
+#define NLOOPS 4000
+
+static void *ptrs[NALLOCS];
+static const size_t sizes[] = {32, 200, 512, 1500};
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double run_single(void) {
+  double start = now();
+  for (int j = 0; j < NLOOPS; j++) {
+    size_t size = sizes[j % (sizeof(sizes) / sizeof(sizes[0]))];
+    for (int i = 0; i < NALLOCS; i++) {
+      ptrs[i] = my_malloc(size);
+      if (ptrs[i] == NULL)
+        abort();
+      *(int *) ptrs[i] = j;
+    }
+    for (int i = 0; i < NALLOCS; i++)
+      my_free(ptrs[i]);
+  }
+  return now() - start;
+}
+
+static double run_batch(void) {
+  double start = now();
+  for (int j = 0; j < NLOOPS; j++) {
+    size_t size = sizes[j % (sizeof(sizes) / sizeof(sizes[0]))];
+    if (my_malloc_batch(size, NALLOCS, ptrs) != NALLOCS)
+      abort();
+    for (int i = 0; i < NALLOCS; i++)
+      *(int *) ptrs[i] = j;
+    my_free_batch(ptrs, NALLOCS);
+  }
+  return now() - start;
+}
+
+int main(void) {
+  double start = now();
+  double single_seconds = run_single();
+  double batch_seconds = run_batch();
+  double time_taken = now() - start;
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  printf("%f %ld\n", time_taken, usage.ru_maxrss);
+  printf("single 1 %d %f\n", NLOOPS * NALLOCS, single_seconds);
+  printf("batch 1 %d %f\n", NLOOPS * NALLOCS, batch_seconds);
+  return 0;
+}
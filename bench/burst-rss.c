@@ -0,0 +1,60 @@
+/* Memory return benchmark: a burst of large allocations and one of small
+   objects, all touched and then freed, followed by a quiet period of small
+   churn.  Emptied chunks are unmapped straight away, the rest decays back
+   to the OS once it has stayed free long enough.  Prints the run time in seconds and the RSS in
+   KB left after the quiet period.  */
+
+#include "../tests/testing.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define NALLOCS 1024
+#define SIZE (256 * 1024)
+#define NSMALL (1 << 20)
+#define SMALL_SIZE 128
+#define NQUIET 12
+
+int main(void) {
+  static void *ptrs[NALLOCS];
+  static void *small[NSMALL];
+  struct timespec start_t, end_t;
+  clock_gettime(CLOCK_MONOTONIC, &start_t);
+
+  /* Free every other block first so no chunk empties until the second
+     pass, leaving coalesced dirty spans behind for as long as possible.  */
+  for (int i = 0; i < NALLOCS; i++) {
+    ptrs[i] = mallocing(SIZE);
+    memset(ptrs[i], i, SIZE);
+  }
+  for (int i = 0; i < NALLOCS; i += 2)
+    freeing(ptrs[i]);
+  for (int i = 1; i < NALLOCS; i += 2)
+    freeing(ptrs[i]);
+
+  /* Same for slab objects: half-full runs first, then empty ones.  */
+  for (int i = 0; i < NSMALL; i++) {
+    small[i] = mallocing(SMALL_SIZE);
+    memset(small[i], i, SMALL_SIZE);
+  }
+  for (int i = 0; i < NSMALL; i += 2)
+    freeing(small[i]);
+  for (int i = 1; i < NSMALL; i += 2)
+    freeing(small[i]);
+
+  clock_gettime(CLOCK_MONOTONIC, &end_t);
+
+  /* Quiet period: large frees now and then give the decay a chance to run,
+     without touching the purged memory again.  */
+  for (int i = 0; i < NQUIET; i++) {
+    usleep(100000);
+    freeing(mallocing(2 * 4096));
+  }
+
+  double time_taken = (end_t.tv_sec - start_t.tv_sec) +
+                      (end_t.tv_nsec - start_t.tv_nsec) / 1e9;
+  printf("%f %zu\n", time_taken, resident_bytes() / 1024);
+  return 0;
+}
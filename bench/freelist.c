@@ -0,0 +1,119 @@
+/* Free list benchmark: a heap holed by freeing every other block of mixed
+   sizes, then churned by freeing a random block and allocating another of
+   a new size in its place, so each call takes, splits or coalesces free
+   blocks spread over many pages.  Sizes stay above the thread cache, so
+   every call goes through the free lists.  Prints the total run time in
+   seconds, then "churn 1 <operations> <seconds>", and "l1d churn <misses>"
+   and "llc churn <misses>" with the L1 data cache and last level cache
+   read misses per malloc and free pair, when those counters can be read.  */
+
+#define _GNU_SOURCE
+#include "../tests/testing.h"
+#include <linux/perf_event.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#define NBLOCKS (1 << 16)
+#define NOPS (1 << 20)
+#define MIN_SIZE 1024
+#define MAX_SIZE (32 * 1024)
+
+static void *blocks[NBLOCKS];
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t next_rand(uint64_t *state) {
+  uint64_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  return *state = x;
+}
+
+static size_t block_size(uint64_t *state) {
+  return MIN_SIZE + next_rand(state) % (MAX_SIZE - MIN_SIZE);
+}
+
+/* Opens a counter of this process's read misses in "cache", -1 if there is
+   none (no PMU, or perf events are not allowed).  */
+static int open_miss_counter(uint64_t cache) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HW_CACHE;
+  attr.config = cache | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static void start_counter(int fd) {
+  if (fd >= 0) {
+    ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+  }
+}
+
+/* Stops the counter and returns its count, -1 if it has none.  */
+static long long stop_counter(int fd) {
+  long long count = -1;
+  if (fd >= 0) {
+    ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    if (read(fd, &count, sizeof(count)) != sizeof(count))
+      count = -1;
+    close(fd);
+  }
+  return count;
+}
+
+int main(void) {
+  double start = now();
+  uint64_t seed = 88172645463325252ull;
+
+  /* Fill the heap, then free every other block so the holes can't merge.  */
+  for (int i = 0; i < NBLOCKS; i++)
+    blocks[i] = mallocing(block_size(&seed));
+  for (int i = 0; i < NBLOCKS; i += 2) {
+    freeing(blocks[i]);
+    blocks[i] = NULL;
+  }
+
+  int l1d = open_miss_counter(PERF_COUNT_HW_CACHE_L1D);
+  int llc = open_miss_counter(PERF_COUNT_HW_CACHE_LL);
+  start_counter(l1d);
+  start_counter(llc);
+  double churn_start = now();
+  for (int i = 0; i < NOPS; i++) {
+    int slot = next_rand(&seed) % NBLOCKS;
+    if (blocks[slot] != NULL)
+      freeing(blocks[slot]);
+    blocks[slot] = mallocing(block_size(&seed));
+  }
+  double churn_seconds = now() - churn_start;
+  long long l1d_misses = stop_counter(l1d);
+  long long llc_misses = stop_counter(llc);
+
+  for (int i = 0; i < NBLOCKS; i++)
+    if (blocks[i] != NULL)
+      freeing(blocks[i]);
+
+  printf("%f\n", now() - start);
+  printf("churn 1 %d %f\n", NOPS, churn_seconds);
+  if (l1d_misses >= 0)
+    printf("l1d churn %.3f\n", (double) l1d_misses / NOPS);
+  if (llc_misses >= 0)
+    printf("llc churn %.3f\n", (double) llc_misses / NOPS);
+  return 0;
+}
@@ -18,10 +18,10 @@
 #include "../tests/testing.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <sys/resource.h>
 #include <time.h>
-// #include "bench-timing.h"
-// #include "json-lib.h"
 
 /* Benchmark the malloc/free performance of a varying number of blocks of a
    given size.  This enables performance tracking of the t-cache and fastbins.
@@ -33,20 +33,29 @@
 #define NUM_ALLOCS 4
 #define MAX_ALLOCS 200
 
-// Daan: disable timing
-typedef long timing_t;
-#define TIMING_NOW(s)
-#define TIMING_DIFF(e, start, stop)
+/* bench-timing.h on the monotonic clock, in nanoseconds.  */
+typedef uint64_t timing_t;
+#define TIMING_NOW(s) ((s) = timing_now())
+#define TIMING_DIFF(e, start, stop) ((e) = (stop) - (start))
+#define TIMING_ACCUM(sum, diff) ((sum) += (diff))
 
+static timing_t timing_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (timing_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Time and malloc/free calls summed over every size benchmarked.  */
 typedef struct {
   size_t iters;
   size_t size;
   int n;
   timing_t elapsed;
+  size_t ops;
 } malloc_args;
 
 static void do_benchmark(malloc_args *args, char **arr) {
-  timing_t start, stop;
+  timing_t start, stop, elapsed;
   size_t iters = args->iters;
   size_t size = args->size;
   int n = args->n;
@@ -74,22 +83,50 @@ static void do_benchmark(malloc_args *args, char **arr) {
 
   TIMING_NOW(stop);
 
-  TIMING_DIFF(args->elapsed, start, stop);
+  TIMING_DIFF(elapsed, start, stop);
+  TIMING_ACCUM(args->elapsed, elapsed);
+  args->ops += 2 * iters * n;
 }
 
 static malloc_args tests[3][NUM_ALLOCS];
 static int allocs[NUM_ALLOCS] = {25, 100, 400, MAX_ALLOCS};
+static int max_threads = 4;
+
+/* Wall time and calls of the thread test, by log2 of the thread count.  */
+#define MAX_THREAD_RUNS 16
+static timing_t thread_elapsed[MAX_THREAD_RUNS];
+static size_t thread_ops[MAX_THREAD_RUNS];
 
 static void *thread_test(void *p) {
-  char **arr = (char **)p;
+  char **arr = (char **)mallocing(MAX_ALLOCS * sizeof(void *));
 
-  /* Run benchmark multi-threaded.  */
-  for (int i = 0; i < NUM_ALLOCS; i++)
-    do_benchmark(&tests[2][i], arr);
+  /* Run benchmark multi-threaded, each thread timing its own copy.  */
+  for (int i = 0; i < NUM_ALLOCS; i++) {
+    malloc_args args = tests[2][i];
+    do_benchmark(&args, arr);
+  }
 
+  freeing(arr);
   return p;
 }
 
+/* Run the thread test concurrently in NTHREADS threads.  */
+static void run_threads(int nthreads, int run) {
+  pthread_t threads[nthreads];
+  timing_t start, stop, elapsed;
+  TIMING_NOW(start);
+  for (int i = 0; i < nthreads; i++)
+    pthread_create(&threads[i], NULL, thread_test, NULL);
+  for (int i = 0; i < nthreads; i++)
+    pthread_join(threads[i], NULL);
+  TIMING_NOW(stop);
+
+  TIMING_DIFF(elapsed, start, stop);
+  TIMING_ACCUM(thread_elapsed[run], elapsed);
+  for (int i = 0; i < NUM_ALLOCS; i++)
+    thread_ops[run] += 2 * nthreads * tests[2][i].iters * tests[2][i].n;
+}
+
 void bench(unsigned long size) {
   size_t iters = NUM_ITERS;
   char **arr = (char **)mallocing(MAX_ALLOCS * sizeof(void *));
@@ -100,70 +137,38 @@ void bench(unsigned long size) {
       tests[t][i].iters = iters / allocs[i];
 
       /* Do a quick warmup run.  */
-      if (t == 0)
-        do_benchmark(&tests[0][i], arr);
+      if (t == 0) {
+        malloc_args warmup = tests[0][i];
+        do_benchmark(&warmup, arr);
+      }
     }
   /* Run benchmark single threaded in main_arena.  */
   for (int i = 0; i < NUM_ALLOCS; i++)
     do_benchmark(&tests[0][i], arr);
-  /* Run benchmark in a thread_arena.  */
-  //   pthread_t t;
-  //   pthread_create(&t, NULL, thread_test, (void *)arr);
-  //   pthread_join(t, NULL);
-  thread_test((void *)arr);
+  /* Run benchmark in thread_arenas, doubling the threads up to MAX_THREADS.  */
+  for (int t = 1, run = 0; t <= max_threads && run < MAX_THREAD_RUNS; t *= 2, run++)
+    run_threads(t, run);
   /* Repeat benchmark in main_arena with SINGLE_THREAD_P == false.  */
   for (int i = 0; i < NUM_ALLOCS; i++)
     do_benchmark(&tests[1][i], arr);
   freeing(arr);
-
-  /*
-  json_ctx_t json_ctx;
-  json_init (&json_ctx, 0, stdout);
-  json_document_begin (&json_ctx);
-  json_attr_string (&json_ctx, "timing_type", TIMING_TYPE);
-  json_attr_object_begin (&json_ctx, "functions");
-  json_attr_object_begin (&json_ctx, "malloc");
-  char s[100];
-  double iters2 = iters;
-  json_attr_object_begin (&json_ctx, "");
-  json_attr_double (&json_ctx, "malloc_block_size", size);
-  struct rusage usage;
-  getrusage (RUSAGE_SELF, &usage);
-  json_attr_double (&json_ctx, "max_rss", usage.ru_maxrss);
-  for (int i = 0; i < NUM_ALLOCS; i++)
-    {
-      sprintf (s, "main_arena_st_allocs_%04d_time", allocs[i]);
-      json_attr_double (&json_ctx, s, tests[0][i].elapsed / iters2);
-    }
-  for (int i = 0; i < NUM_ALLOCS; i++)
-    {
-      sprintf (s, "main_arena_mt_allocs_%04d_time", allocs[i]);
-      json_attr_double (&json_ctx, s, tests[1][i].elapsed / iters2);
-    }
-  for (int i = 0; i < NUM_ALLOCS; i++)
-    {
-      sprintf (s, "thread_arena__allocs_%04d_time", allocs[i]);
-      json_attr_double (&json_ctx, s, tests[2][i].elapsed / iters2);
-    }
-  json_attr_object_end (&json_ctx);
-  json_attr_object_end (&json_ctx);
-  json_attr_object_end (&json_ctx);
-  json_document_end (&json_ctx);
-  */
 }
 
 static void usage(const char *name) {
-  fprintf(stderr, "%s: <alloc_size>\n", name);
+  fprintf(stderr, "%s: <alloc_size> [max_threads]\n", name);
   exit(1);
 }
 
 int main(int argc, char **argv) {
-  clock_t start_t = clock();
+  struct timespec start_t, end_t;
+  clock_gettime(CLOCK_MONOTONIC, &start_t);
   long size = 16;
-  if (argc == 2)
+  if (argc >= 2)
     size = strtol(argv[1], NULL, 0);
+  if (argc >= 3)
+    max_threads = strtol(argv[2], NULL, 0);
 
-  if (argc > 2 || size <= 0)
+  if (argc > 3 || size <= 0 || max_threads <= 0)
     usage(argv[0]);
 
   for (int i = 0; i < 100; i++) {
@@ -177,8 +182,23 @@ int main(int argc, char **argv) {
     bench(14 * size);
     bench(16 * size);
   }
-  clock_t end_t = clock();
-  double time_taken = (double)(end_t - start_t) / CLOCKS_PER_SEC;
+  /* Wall time, so the threaded runs show how the allocator scales.  */
+  clock_gettime(CLOCK_MONOTONIC, &end_t);
+  double time_taken = (end_t.tv_sec - start_t.tv_sec) +
+                      (end_t.tv_nsec - start_t.tv_nsec) / 1e9;
   printf("%f\n", time_taken);
+
+  /* Then each scenario: name, threads, malloc and free calls, seconds.
+     Block counts above NUM_ITERS get no iterations and are left out.  */
+  for (int i = 0; i < NUM_ALLOCS; i++)
+    if (tests[0][i].ops > 0)
+      printf("main_arena_st_allocs_%04d 1 %zu %f\n", allocs[i], tests[0][i].ops,
+             tests[0][i].elapsed / 1e9);
+  for (int i = 0; i < NUM_ALLOCS; i++)
+    if (tests[1][i].ops > 0)
+      printf("main_arena_mt_allocs_%04d 1 %zu %f\n", allocs[i], tests[1][i].ops,
+             tests[1][i].elapsed / 1e9);
+  for (int t = 1, run = 0; t <= max_threads && run < MAX_THREAD_RUNS; t *= 2, run++)
+    printf("thread_arena %d %zu %f\n", t, thread_ops[run], thread_elapsed[run] / 1e9);
   return 0;
 }
\ No newline at end of file
@@ -0,0 +1,50 @@
+/* Large block fragmentation benchmark, after tests/large.c: rounds of large
+   allocations of varying sizes, each freeing every other block so the heap
+   fills with holes of many sizes that later rounds must be fitted into.
+   Prints the run time in seconds and the peak RSS in KB.  */
+
+#include "../tests/testing.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#define NALLOCS 400
+#define NLOOPS 200
+#define MIN_SIZE 4096
+#define MAX_SIZE (256 * 1024)
+
+int main(void) {
+  static void *ptrs[NLOOPS][NALLOCS];
+  struct timespec start_t, end_t;
+  clock_gettime(CLOCK_MONOTONIC, &start_t);
+
+  unsigned int seed = 1;
+  for (int j = 0; j < NLOOPS; j++) {
+    for (int i = 0; i < NALLOCS; i++) {
+      seed = seed * 1103515245 + 12345;
+      size_t size = MIN_SIZE + seed % (MAX_SIZE - MIN_SIZE);
+      ptrs[j][i] = mallocing(size);
+      memset(ptrs[j][i], j, 64);
+    }
+    for (int i = j % 2; i < NALLOCS; i += 2) {
+      freeing(ptrs[j][i]);
+      ptrs[j][i] = NULL;
+    }
+    /* Drop older rounds entirely so the live set stays bounded.  */
+    if (j >= 4) {
+      for (int i = 0; i < NALLOCS; i++)
+        if (ptrs[j - 4][i] != NULL)
+          freeing(ptrs[j - 4][i]);
+    }
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &end_t);
+  double time_taken = (end_t.tv_sec - start_t.tv_sec) +
+                      (end_t.tv_nsec - start_t.tv_nsec) / 1e9;
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  printf("%f %ld\n", time_taken, usage.ru_maxrss);
+  return 0;
+}
@@ -0,0 +1,90 @@
+/* Cross-thread free benchmark: producers allocate buffers and hand them to
+   consumers over a ring, consumers write to and free them.  Every free
+   happens on a different thread from the matching malloc, which is the
+   path served by the remote free lists.  */
+
+#include "../tests/testing.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define RING_SIZE 1024
+#define MAX_SIZE 512
+
+/* Single producer, single consumer ring of pointers.  */
+typedef struct {
+  void *slots[RING_SIZE];
+  _Atomic size_t head;
+  _Atomic size_t tail;
+  size_t items;
+} ring_t;
+
+static void *producer(void *p) {
+  ring_t *ring = p;
+  for (size_t i = 0; i < ring->items; i++) {
+    size_t size = 16 + (i * 7919) % MAX_SIZE;
+    void *ptr = mallocing(size);
+
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    while (head - atomic_load_explicit(&ring->tail, memory_order_acquire) == RING_SIZE)
+      sched_yield();
+    ring->slots[head % RING_SIZE] = ptr;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+  }
+  return NULL;
+}
+
+static void *consumer(void *p) {
+  ring_t *ring = p;
+  for (size_t i = 0; i < ring->items; i++) {
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    while (atomic_load_explicit(&ring->head, memory_order_acquire) == tail)
+      sched_yield();
+    void *ptr = ring->slots[tail % RING_SIZE];
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+
+    memset(ptr, 0, 16);
+    freeing(ptr);
+  }
+  return NULL;
+}
+
+static void usage(const char *name) {
+  fprintf(stderr, "%s: [pairs] [items]\n", name);
+  exit(1);
+}
+
+int main(int argc, char **argv) {
+  long pairs = 2;
+  long items = 500000;
+  if (argc >= 2)
+    pairs = strtol(argv[1], NULL, 0);
+  if (argc >= 3)
+    items = strtol(argv[2], NULL, 0);
+  if (argc > 3 || pairs <= 0 || items <= 0)
+    usage(argv[0]);
+
+  struct timespec start_t, end_t;
+  clock_gettime(CLOCK_MONOTONIC, &start_t);
+
+  ring_t *rings = calloc(pairs, sizeof(ring_t));
+  pthread_t threads[2 * pairs];
+  for (long i = 0; i < pairs; i++) {
+    rings[i].items = items;
+    pthread_create(&threads[2 * i], NULL, producer, &rings[i]);
+    pthread_create(&threads[2 * i + 1], NULL, consumer, &rings[i]);
+  }
+  for (long i = 0; i < 2 * pairs; i++)
+    pthread_join(threads[i], NULL);
+  free(rings);
+
+  clock_gettime(CLOCK_MONOTONIC, &end_t);
+  double time_taken = (end_t.tv_sec - start_t.tv_sec) +
+                      (end_t.tv_nsec - start_t.tv_nsec) / 1e9;
+  printf("%f\n", time_taken);
+  return 0;
+}
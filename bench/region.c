@@ -0,0 +1,64 @@
+/* Region benchmark: requests that each build up objects of mixed small
+   sizes and drop them all at the end, once with my_malloc and my_free per
+   object and once with a region reset per request.  Prints the total run
+   time in seconds, then "<scenario> 1 <objects> <seconds>" for each.  */
+
+#include "../tests/testing.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define NREQUESTS 20000
+#define NOBJECTS 200
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static size_t object_size(int request, int i) {
+  return 16 + (request * 31 + i * 17) % 240;
+}
+
+static double run_malloc(void) {
+  static void *objs[NOBJECTS];
+  double start = now();
+  for (int r = 0; r < NREQUESTS; r++) {
+    for (int i = 0; i < NOBJECTS; i++) {
+      objs[i] = mallocing(object_size(r, i));
+      *(int *) objs[i] = i;
+    }
+    for (int i = 0; i < NOBJECTS; i++)
+      freeing(objs[i]);
+  }
+  return now() - start;
+}
+
+static double run_region(void) {
+  my_region *region = my_region_create();
+  CHECK_NULL(region);
+  double start = now();
+  for (int r = 0; r < NREQUESTS; r++) {
+    for (int i = 0; i < NOBJECTS; i++) {
+      int *obj = my_region_alloc(region, object_size(r, i));
+      CHECK_NULL(obj);
+      *obj = i;
+    }
+    my_region_reset(region);
+  }
+  double seconds = now() - start;
+  my_region_destroy(region);
+  return seconds;
+}
+
+int main(void) {
+  double start = now();
+  double malloc_seconds = run_malloc();
+  double region_seconds = run_region();
+  printf("%f\n", now() - start);
+  printf("malloc 1 %d %f\n", NREQUESTS * NOBJECTS, malloc_seconds);
+  printf("region 1 %d %f\n", NREQUESTS * NOBJECTS, region_seconds);
+  return 0;
+}
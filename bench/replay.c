@@ -0,0 +1,398 @@
+/* Trace replay: runs an allocation trace recorded with MYMALLOC_TRACE
+   against the allocator this is linked with.  Every traced thread's calls
+   are replayed in their order on one of up to max_threads threads (traced
+   thread modulo max_threads).  A free or realloc of a block another thread
+   allocates waits until that thread has, so the calls of each thread and
+   the blocks they get are the same on every run.  Every page of a new
+   block is touched, outside the timed call.
+
+   Prints the run time in seconds and the peak RSS the replay added in KB,
+   then "replay <threads> <calls> <seconds>", then one line per call kind:
+   "latency <call> <count> <p50 ns> <p99 ns> <max ns>".  */
+
+#include "../mymalloc.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_THREADS 64
+#define NUM_CALLS (MY_TRACE_FREE + 1)
+
+/* Latency buckets: 8 per power of two of nanoseconds.  */
+#define SUB_BITS 3
+#define NUM_BUCKETS (64 << SUB_BITS)
+
+static const char *const call_names[NUM_CALLS] = {
+  "malloc", "calloc", "memalign", NULL, "realloc", "free"
+};
+
+/* A call to replay.  Blocks are numbered in the order they are allocated;
+   realloc frees "old" and allocates "id".  */
+typedef struct {
+  uint64_t size;
+  uint32_t id;
+  uint32_t old;
+  uint16_t call;
+  uint16_t align;
+  uint32_t thread;
+} op_t;
+
+typedef struct {
+  const op_t *ops;
+  size_t num_ops;
+  uint64_t hist[NUM_CALLS][NUM_BUCKETS];
+  uint64_t max[NUM_CALLS];
+} worker_t;
+
+static _Atomic(void *) *blocks;
+static long page_size;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int bucket_of(uint64_t ns) {
+  if (ns < (1 << SUB_BITS))
+    return ns;
+  int msb = 63 - __builtin_clzll(ns);
+  return ((msb - SUB_BITS + 1) << SUB_BITS) | ((ns >> (msb - SUB_BITS)) & ((1 << SUB_BITS) - 1));
+}
+
+/* Largest latency that falls in "bucket".  */
+static uint64_t bucket_limit(int bucket) {
+  if (bucket < (1 << SUB_BITS))
+    return bucket;
+  int msb = (bucket >> SUB_BITS) + SUB_BITS - 1;
+  uint64_t base = (1ull << SUB_BITS | (bucket & ((1 << SUB_BITS) - 1))) << (msb - SUB_BITS);
+  return base + (1ull << (msb - SUB_BITS)) - 1;
+}
+
+/* Block "id", once its allocating thread has stored it.  */
+static void *wait_block(uint32_t id) {
+  void *ptr;
+  while ((ptr = atomic_load_explicit(&blocks[id], memory_order_acquire)) == NULL)
+    sched_yield();
+  return ptr;
+}
+
+static void store_block(uint32_t id, void *ptr, size_t size) {
+  if (ptr == NULL) {
+    fprintf(stderr, "replay: out of memory allocating %zu bytes\n", size);
+    exit(1);
+  }
+  for (size_t off = 0; off < size; off += page_size)
+    ((volatile char *) ptr)[off] = 1;
+  atomic_store_explicit(&blocks[id], ptr, memory_order_release);
+}
+
+static void *worker(void *p) {
+  worker_t *w = p;
+  for (size_t i = 0; i < w->num_ops; i++) {
+    const op_t *op = &w->ops[i];
+    void *ptr = NULL;
+    uint64_t start, elapsed;
+    switch (op->call) {
+    case MY_TRACE_MALLOC:
+      start = now_ns();
+      ptr = my_malloc(op->size);
+      elapsed = now_ns() - start;
+      break;
+    case MY_TRACE_CALLOC:
+      start = now_ns();
+      ptr = my_calloc(1, op->size);
+      elapsed = now_ns() - start;
+      break;
+    case MY_TRACE_MEMALIGN:
+      start = now_ns();
+      ptr = my_memalign((size_t) 1 << op->align, op->size);
+      elapsed = now_ns() - start;
+      break;
+    case MY_TRACE_REALLOC:
+      ptr = wait_block(op->old);
+      start = now_ns();
+      ptr = my_realloc(ptr, op->size);
+      elapsed = now_ns() - start;
+      atomic_store_explicit(&blocks[op->old], NULL, memory_order_relaxed);
+      break;
+    default:
+      ptr = wait_block(op->id);
+      start = now_ns();
+      if (op->size > 0)
+        my_free_sized(ptr, op->size);
+      else
+        my_free(ptr);
+      elapsed = now_ns() - start;
+      atomic_store_explicit(&blocks[op->id], NULL, memory_order_relaxed);
+      ptr = NULL;
+      break;
+    }
+    if (op->call != MY_TRACE_FREE)
+      store_block(op->id, ptr, op->size);
+
+    w->hist[op->call][bucket_of(elapsed)]++;
+    if (elapsed > w->max[op->call])
+      w->max[op->call] = elapsed;
+  }
+  return NULL;
+}
+
+static int by_seq(const void *a, const void *b) {
+  uint64_t x = ((const my_trace_record *) a)->seq;
+  uint64_t y = ((const my_trace_record *) b)->seq;
+  return x < y ? -1 : x > y;
+}
+
+/* Open addressing map from the addresses of live blocks to their ids.  */
+typedef struct {
+  uint64_t addr;
+  uint32_t id;
+} slot_t;
+
+static slot_t *map;
+static size_t map_mask;
+
+static size_t map_find(uint64_t addr) {
+  size_t i = (addr >> 4) * 0x9e3779b97f4a7c15ull & map_mask;
+  while (map[i].addr != 0 && map[i].addr != addr)
+    i = (i + 1) & map_mask;
+  return i;
+}
+
+static void map_put(uint64_t addr, uint32_t id) {
+  size_t i = map_find(addr);
+  map[i] = (slot_t){addr, id};
+}
+
+/* Removes "addr", returning its id, or UINT32_MAX if it isn't there.  */
+static uint32_t map_take(uint64_t addr) {
+  size_t i = map_find(addr);
+  if (map[i].addr == 0)
+    return UINT32_MAX;
+  uint32_t id = map[i].id;
+  /* Shift back the entries that probed past the hole.  */
+  size_t hole = i;
+  for (size_t j = (i + 1) & map_mask; map[j].addr != 0; j = (j + 1) & map_mask) {
+    size_t home = (map[j].addr >> 4) * 0x9e3779b97f4a7c15ull & map_mask;
+    if (((j - home) & map_mask) >= ((j - hole) & map_mask)) {
+      map[hole] = map[j];
+      hole = j;
+    }
+  }
+  map[hole].addr = 0;
+  return id;
+}
+
+/* Turns the records, sorted by sequence, into calls on block ids.  Calls on
+   blocks the trace never allocated are dropped.  Returns the number of
+   calls, and sets the number of blocks and traced threads.  */
+static size_t build_ops(const my_trace_record *records, size_t n, op_t *ops,
+                        uint32_t *num_blocks, uint32_t *num_threads) {
+  uint32_t threads = 0;
+  for (size_t i = 0; i < n; i++)
+    if (records[i].thread >= threads)
+      threads = records[i].thread + 1;
+  /* The block each thread's unfinished realloc was given.  */
+  uint64_t *realloc_addr = calloc(threads, sizeof(uint64_t));
+  uint32_t *realloc_id = calloc(threads, sizeof(uint32_t));
+
+  size_t map_size = 16;
+  while (map_size < 2 * n)
+    map_size *= 2;
+  map = calloc(map_size, sizeof(slot_t));
+  map_mask = map_size - 1;
+  if (realloc_addr == NULL || realloc_id == NULL || map == NULL)
+    abort();
+
+  size_t num_ops = 0;
+  uint32_t ids = 0;
+  for (size_t i = 0; i < n; i++) {
+    const my_trace_record *r = &records[i];
+    op_t op = {r->size, 0, 0, r->op, r->align, r->thread};
+    switch (r->op) {
+    case MY_TRACE_MALLOC:
+    case MY_TRACE_CALLOC:
+    case MY_TRACE_MEMALIGN:
+      op.id = ids++;
+      map_put(r->ptr, op.id);
+      break;
+    case MY_TRACE_REALLOC_FROM:
+      /* Taken now, another thread may get the address before the realloc
+         returns.  */
+      realloc_addr[r->thread] = r->ptr;
+      realloc_id[r->thread] = map_take(r->ptr);
+      continue;
+    case MY_TRACE_REALLOC:
+      op.old = realloc_id[r->thread];
+      if (op.old == UINT32_MAX)
+        continue;
+      if (r->ptr == 0) {
+        /* Failed, the block stays where it was.  */
+        map_put(realloc_addr[r->thread], op.old);
+        continue;
+      }
+      op.id = ids++;
+      map_put(r->ptr, op.id);
+      break;
+    case MY_TRACE_FREE:
+      op.id = map_take(r->ptr);
+      if (op.id == UINT32_MAX)
+        continue;
+      break;
+    default:
+      fprintf(stderr, "replay: unknown call %d\n", r->op);
+      exit(1);
+    }
+    if (op.size == 0 && op.call != MY_TRACE_FREE)
+      op.size = 1;
+    ops[num_ops++] = op;
+  }
+
+  free(map);
+  free(realloc_addr);
+  free(realloc_id);
+  *num_blocks = ids;
+  *num_threads = threads;
+  return num_ops;
+}
+
+static long status_kb(const char *field) {
+  char line[256];
+  long kb = 0;
+  FILE *f = fopen("/proc/self/status", "r");
+  if (f == NULL)
+    return 0;
+  while (fgets(line, sizeof(line), f) != NULL)
+    if (strncmp(line, field, strlen(field)) == 0)
+      kb = strtol(line + strlen(field), NULL, 10);
+  fclose(f);
+  return kb;
+}
+
+static void usage(const char *name) {
+  fprintf(stderr, "%s: <trace> [max_threads]\n", name);
+  exit(1);
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2 || argc > 3)
+    usage(argv[0]);
+  long max_threads = argc > 2 ? strtol(argv[2], NULL, 0) : MAX_THREADS;
+  if (max_threads <= 0 || max_threads > MAX_THREADS)
+    usage(argv[0]);
+  page_size = sysconf(_SC_PAGESIZE);
+
+  int fd = open(argv[1], O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(my_trace_header)) {
+    fprintf(stderr, "replay: cannot read %s\n", argv[1]);
+    return 1;
+  }
+  /* Private, so the records can be sorted in place.  */
+  char *file = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if (file == MAP_FAILED)
+    abort();
+  close(fd);
+  my_trace_header *header = (my_trace_header *) file;
+  if (memcmp(header->magic, MY_TRACE_MAGIC, sizeof(header->magic)) != 0 ||
+      header->version != MY_TRACE_VERSION ||
+      header->record_size != sizeof(my_trace_record)) {
+    fprintf(stderr, "replay: %s is not a version %d trace\n", argv[1], MY_TRACE_VERSION);
+    return 1;
+  }
+
+  /* Threads write their records a buffer at a time, so only the sequence
+     puts them back in order.  */
+  my_trace_record *records = (my_trace_record *) (file + sizeof(my_trace_header));
+  size_t n = (st.st_size - sizeof(my_trace_header)) / sizeof(my_trace_record);
+  qsort(records, n, sizeof(my_trace_record), by_seq);
+
+  op_t *ops = malloc((n + 1) * sizeof(op_t));
+  if (ops == NULL)
+    abort();
+  uint32_t num_blocks, traced_threads;
+  size_t num_ops = build_ops(records, n, ops, &num_blocks, &traced_threads);
+  munmap(file, st.st_size);
+
+  /* Each thread's calls together, in trace order.  */
+  int threads = traced_threads < max_threads ? traced_threads : max_threads;
+  if (threads == 0)
+    threads = 1;
+  size_t counts[MAX_THREADS] = {0};
+  for (size_t i = 0; i < num_ops; i++)
+    counts[ops[i].thread % threads]++;
+  op_t *sorted = malloc((num_ops + 1) * sizeof(op_t));
+  worker_t *workers = calloc(threads, sizeof(worker_t));
+  blocks = calloc(num_blocks + 1, sizeof(void *));
+  if (sorted == NULL || workers == NULL || blocks == NULL)
+    abort();
+  size_t next[MAX_THREADS];
+  size_t offset = 0;
+  for (int t = 0; t < threads; t++) {
+    workers[t].ops = sorted + offset;
+    workers[t].num_ops = counts[t];
+    next[t] = offset;
+    offset += counts[t];
+  }
+  for (size_t i = 0; i < num_ops; i++)
+    sorted[next[ops[i].thread % threads]++] = ops[i];
+  free(ops);
+
+  /* Peak RSS counts from here, with the calls loaded.  */
+  int clear = open("/proc/self/clear_refs", O_WRONLY);
+  if (clear >= 0) {
+    if (write(clear, "5", 1) != 1)
+      clear = -1;
+    close(clear);
+  }
+  long rss_before = status_kb("VmRSS:");
+
+  pthread_t ids[MAX_THREADS];
+  uint64_t start = now_ns();
+  for (int t = 0; t < threads; t++)
+    pthread_create(&ids[t], NULL, worker, &workers[t]);
+  for (int t = 0; t < threads; t++)
+    pthread_join(ids[t], NULL);
+  double seconds = (now_ns() - start) / 1e9;
+  long footprint = status_kb("VmHWM:") - rss_before;
+
+  for (uint32_t i = 0; i < num_blocks; i++)
+    my_free(atomic_load_explicit(&blocks[i], memory_order_relaxed));
+
+  printf("%f %ld\n", seconds, footprint > 0 ? footprint : 0);
+  printf("replay %d %zu %f\n", threads, num_ops, seconds);
+  for (int call = 0; call < NUM_CALLS; call++) {
+    uint64_t count = 0, max = 0;
+    for (int t = 0; t < threads; t++) {
+      for (int b = 0; b < NUM_BUCKETS; b++)
+        count += workers[t].hist[call][b];
+      if (workers[t].max[call] > max)
+        max = workers[t].max[call];
+    }
+    if (count == 0)
+      continue;
+
+    uint64_t p50 = UINT64_MAX, p99 = UINT64_MAX, seen = 0;
+    for (int b = 0; b < NUM_BUCKETS && p99 == UINT64_MAX; b++) {
+      for (int t = 0; t < threads; t++)
+        seen += workers[t].hist[call][b];
+      if (p50 == UINT64_MAX && seen * 2 >= count)
+        p50 = bucket_limit(b);
+      if (seen * 100 >= count * 99)
+        p99 = bucket_limit(b);
+    }
+    printf("latency %s %lu %lu %lu %lu\n", call_names[call], count,
+           p50 < max ? p50 : max, p99 < max ? p99 : max, max);
+  }
+  return 0;
+}
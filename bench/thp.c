@@ -0,0 +1,150 @@
+/* Huge page benchmark: many small objects allocated, linked in a random
+   cycle and then chased, so nearly every step lands on another page.  Runs
+   once per MYMALLOC_THP mode, each in its own child process since the mode
+   is read at the first allocation.  Prints the total run time in seconds,
+   then "<scenario>-<mode> 1 <operations> <seconds>" for the allocation and
+   the access phase, and "dtlb <scenario>-<mode> <misses>" for the access
+   phase when the dTLB miss counter can be read.  */
+
+#define _GNU_SOURCE
+#include "../tests/testing.h"
+#include <linux/perf_event.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define NOBJECTS (1 << 20)
+#define NSTEPS (1 << 23)
+#define NMODES 3
+
+static const char *const modes[NMODES] = {"off", "madvise", "hugetlb"};
+
+typedef struct {
+  double alloc_seconds;
+  double access_seconds;
+  long long dtlb_misses;
+  uint64_t checksum;
+} result_t;
+
+typedef struct node {
+  struct node *next;
+  uint64_t value;
+} node_t;
+
+static void *objs[NOBJECTS];
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t next_rand(uint64_t *state) {
+  uint64_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  return *state = x;
+}
+
+/* Opens a counter of this process's dTLB read misses, -1 if there is none
+   (no PMU, or perf events are not allowed).  */
+static int open_dtlb_counter(void) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HW_CACHE;
+  attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static void run(result_t *result) {
+  uint64_t seed = 88172645463325252ull;
+
+  /* Mixed sizes, so the objects spread over many pages of the heap.  */
+  double start = now();
+  for (int i = 0; i < NOBJECTS; i++) {
+    objs[i] = mallocing(sizeof(node_t) + next_rand(&seed) % 240);
+    ((node_t *) objs[i])->value = i;
+  }
+  result->alloc_seconds = now() - start;
+
+  /* Shuffle, then link the objects into one cycle in that order.  */
+  for (int i = NOBJECTS - 1; i > 0; i--) {
+    int j = next_rand(&seed) % (i + 1);
+    void *tmp = objs[i];
+    objs[i] = objs[j];
+    objs[j] = tmp;
+  }
+  for (int i = 0; i < NOBJECTS; i++)
+    ((node_t *) objs[i])->next = objs[(i + 1) % NOBJECTS];
+
+  int fd = open_dtlb_counter();
+  if (fd >= 0) {
+    ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+  }
+  start = now();
+  node_t *node = objs[0];
+  uint64_t sum = 0;
+  for (int i = 0; i < NSTEPS; i++) {
+    sum += node->value;
+    node = node->next;
+  }
+  result->access_seconds = now() - start;
+  result->dtlb_misses = -1;
+  if (fd >= 0) {
+    ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    long long misses;
+    if (read(fd, &misses, sizeof(misses)) == sizeof(misses))
+      result->dtlb_misses = misses;
+    close(fd);
+  }
+  result->checksum = sum;
+
+  for (int i = 0; i < NOBJECTS; i++)
+    freeing(objs[i]);
+}
+
+int main(void) {
+  double start = now();
+  result_t *results = mmap(NULL, NMODES * sizeof(result_t), PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (results == MAP_FAILED)
+    abort();
+
+  for (int m = 0; m < NMODES; m++) {
+    pid_t pid = fork();
+    if (pid < 0)
+      abort();
+    if (pid == 0) {
+      setenv("MYMALLOC_THP", modes[m], 1);
+      run(&results[m]);
+      _exit(0);
+    }
+    int status;
+    if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+      abort();
+  }
+
+  printf("%f\n", now() - start);
+  for (int m = 0; m < NMODES; m++) {
+    printf("alloc-%s 1 %d %f\n", modes[m], NOBJECTS, results[m].alloc_seconds);
+    printf("access-%s 1 %d %f\n", modes[m], NSTEPS, results[m].access_seconds);
+  }
+  for (int m = 0; m < NMODES; m++)
+    if (results[m].dtlb_misses >= 0)
+      printf("dtlb access-%s %lld\n", modes[m], results[m].dtlb_misses);
+  return 0;
+}
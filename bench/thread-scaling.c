@@ -0,0 +1,292 @@
+/* Multi-threaded scenario suite.  Each scenario runs with 1, 2, 4 ... up to
+   the maximum number of threads, every thread doing the same amount of work:
+
+   larson         server churn after Larson & Krishnan: threads replace
+                  random slots of their own slice, and each round the
+                  slices move to freshly created threads, which free what
+                  the previous owners allocated.
+   xthread        producer/consumer pairs, every free on another thread.
+   cache-scratch  after Hoard's cache-scratch: each thread frees an object
+                  the main thread allocated, then repeatedly allocates a
+                  small object and writes to it, which is slow if objects
+                  of different threads share a cache line.
+   mstress        mixed sizes, mostly small with some large, swapped in and
+                  out of a table shared by all threads.
+
+   Prints the total run time in seconds, then one line per scenario and
+   thread count: "<scenario> <threads> <operations> <seconds>".  */
+
+#include "../tests/testing.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_THREADS 64
+#define MAX_RESULTS 64
+
+typedef struct {
+  const char *scenario;
+  int threads;
+  size_t ops;
+  double seconds;
+} result_t;
+
+static result_t results[MAX_RESULTS];
+static int num_results;
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t next_rand(uint64_t *state) {
+  uint64_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  return *state = x;
+}
+
+static void record(const char *scenario, int threads, size_t ops, double seconds) {
+  if (num_results < MAX_RESULTS)
+    results[num_results++] = (result_t){scenario, threads, ops, seconds};
+}
+
+/* Starts "threads" threads running "fn" on consecutive elements of "args",
+   each "size" bytes, and waits for them all.  */
+static void run_threads(int threads, void *(*fn)(void *), void *args, size_t size) {
+  pthread_t ids[MAX_THREADS];
+  for (int i = 0; i < threads; i++)
+    pthread_create(&ids[i], NULL, fn, (char *)args + i * size);
+  for (int i = 0; i < threads; i++)
+    pthread_join(ids[i], NULL);
+}
+
+/* Larson: rounds of threads churning their slice of the slot table.  */
+#define LARSON_SLOTS 1000
+#define LARSON_ROUNDS 30
+#define LARSON_OPS 50000
+#define LARSON_MIN 16
+#define LARSON_MAX 512
+
+typedef struct {
+  void **slots;
+  uint64_t seed;
+} larson_t;
+
+static void *larson_worker(void *p) {
+  larson_t *arg = p;
+  for (int i = 0; i < LARSON_OPS; i++) {
+    size_t slot = next_rand(&arg->seed) % LARSON_SLOTS;
+    size_t size = LARSON_MIN + next_rand(&arg->seed) % (LARSON_MAX - LARSON_MIN);
+    freeing(arg->slots[slot]);
+    arg->slots[slot] = mallocing(size);
+    memset(arg->slots[slot], i, 16);
+  }
+  return NULL;
+}
+
+static void larson(int threads) {
+  void **table = mallocing(threads * LARSON_SLOTS * sizeof(void *));
+  for (int i = 0; i < threads * LARSON_SLOTS; i++)
+    table[i] = mallocing(LARSON_MIN);
+
+  larson_t args[MAX_THREADS];
+  double start = now();
+  for (int round = 0; round < LARSON_ROUNDS; round++) {
+    /* Each round hands every slice to a new thread.  */
+    for (int i = 0; i < threads; i++)
+      args[i] = (larson_t){table + ((i + round) % threads) * LARSON_SLOTS,
+                           0x9e3779b97f4a7c15ull * (round * MAX_THREADS + i + 1)};
+    run_threads(threads, larson_worker, args, sizeof(larson_t));
+  }
+  double seconds = now() - start;
+
+  for (int i = 0; i < threads * LARSON_SLOTS; i++)
+    freeing(table[i]);
+  freeing(table);
+  /* A free and a malloc per step.  */
+  record("larson", threads, 2ul * threads * LARSON_ROUNDS * LARSON_OPS, seconds);
+}
+
+/* Cross-thread producer/consumer pairs over single producer rings.  */
+#define RING_SIZE 1024
+#define XTHREAD_ITEMS 1000000
+#define XTHREAD_MAX 512
+
+typedef struct {
+  void *slots[RING_SIZE];
+  _Atomic size_t head;
+  _Atomic size_t tail;
+} ring_t;
+
+typedef struct {
+  int index;
+  ring_t *ring;
+} xthread_t;
+
+static void producer(ring_t *ring) {
+  for (size_t i = 0; i < XTHREAD_ITEMS; i++) {
+    void *ptr = mallocing(16 + (i * 7919) % XTHREAD_MAX);
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    while (head - atomic_load_explicit(&ring->tail, memory_order_acquire) == RING_SIZE)
+      sched_yield();
+    ring->slots[head % RING_SIZE] = ptr;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+  }
+}
+
+static void consumer(ring_t *ring) {
+  for (size_t i = 0; i < XTHREAD_ITEMS; i++) {
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    while (atomic_load_explicit(&ring->head, memory_order_acquire) == tail)
+      sched_yield();
+    void *ptr = ring->slots[tail % RING_SIZE];
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+    memset(ptr, 0, 16);
+    freeing(ptr);
+  }
+}
+
+static void *xthread_worker(void *p) {
+  /* Even threads produce into the ring they share with the next one.  */
+  xthread_t *arg = p;
+  if (arg->index % 2 == 0)
+    producer(arg->ring);
+  else
+    consumer(arg->ring);
+  return NULL;
+}
+
+static void xthread(int threads) {
+  if (threads < 2)
+    return;
+  int pairs = threads / 2;
+  ring_t *rings = mallocing(pairs * sizeof(ring_t));
+  memset(rings, 0, pairs * sizeof(ring_t));
+
+  xthread_t args[MAX_THREADS];
+  for (int i = 0; i < 2 * pairs; i++)
+    args[i] = (xthread_t){i, &rings[i / 2]};
+
+  double start = now();
+  run_threads(2 * pairs, xthread_worker, args, sizeof(xthread_t));
+  double seconds = now() - start;
+
+  freeing(rings);
+  record("xthread", 2 * pairs, 2ul * pairs * XTHREAD_ITEMS, seconds);
+}
+
+/* Cache-scratch: small objects written over and over.  */
+#define SCRATCH_ITERS 30000
+#define SCRATCH_WRITES 500
+#define SCRATCH_SIZE 8
+
+static void *scratch_worker(void *p) {
+  freeing(*(void **)p);
+  for (int i = 0; i < SCRATCH_ITERS; i++) {
+    volatile char *obj = mallocing(SCRATCH_SIZE);
+    for (int j = 0; j < SCRATCH_WRITES; j++)
+      for (int k = 0; k < SCRATCH_SIZE; k++)
+        obj[k]++;
+    freeing((void *)obj);
+  }
+  return NULL;
+}
+
+static void cache_scratch(int threads) {
+  /* Allocated together, so they are neighbours handed to each thread.  */
+  void *objs[MAX_THREADS];
+  for (int i = 0; i < threads; i++)
+    objs[i] = mallocing(SCRATCH_SIZE);
+
+  double start = now();
+  run_threads(threads, scratch_worker, objs, sizeof(void *));
+  double seconds = now() - start;
+  record("cache-scratch", threads, (size_t)threads * SCRATCH_ITERS, seconds);
+}
+
+/* Mstress: a shared table of mixed size objects.  */
+#define MSTRESS_SLOTS 4096
+#define MSTRESS_OPS 500000
+
+static _Atomic(void *) mstress_table[MSTRESS_SLOTS];
+
+static size_t mstress_size(uint64_t *seed) {
+  uint64_t r = next_rand(seed);
+  switch (r % 20) {
+  case 0:
+    return 4096 + (r >> 8) % (256 * 1024);
+  case 1: case 2: case 3: case 4: case 5:
+    return 256 + (r >> 8) % 3840;
+  default:
+    return 8 + (r >> 8) % 248;
+  }
+}
+
+static void *mstress_worker(void *p) {
+  uint64_t seed = *(uint64_t *)p;
+  for (int i = 0; i < MSTRESS_OPS; i++) {
+    size_t slot = next_rand(&seed) % MSTRESS_SLOTS;
+    /* Mostly replace, sometimes just empty the slot.  */
+    void *ptr = NULL;
+    if (next_rand(&seed) % 4 != 0) {
+      size_t size = mstress_size(&seed);
+      ptr = mallocing(size);
+      memset(ptr, i, size < 64 ? size : 64);
+    }
+    freeing(atomic_exchange(&mstress_table[slot], ptr));
+  }
+  return NULL;
+}
+
+static void mstress(int threads) {
+  uint64_t seeds[MAX_THREADS];
+  for (int i = 0; i < threads; i++)
+    seeds[i] = 0x2545f4914f6cdd1dull * (i + 1);
+
+  double start = now();
+  run_threads(threads, mstress_worker, seeds, sizeof(uint64_t));
+  double seconds = now() - start;
+
+  for (int i = 0; i < MSTRESS_SLOTS; i++)
+    freeing(atomic_exchange(&mstress_table[i], NULL));
+  record("mstress", threads, (size_t)threads * MSTRESS_OPS, seconds);
+}
+
+static void usage(const char *name) {
+  fprintf(stderr, "%s: [max_threads]\n", name);
+  exit(1);
+}
+
+int main(int argc, char **argv) {
+  /* At least two, so the cross-thread scenarios always run.  */
+  long max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+  if (max_threads < 2)
+    max_threads = 2;
+  if (argc >= 2)
+    max_threads = strtol(argv[1], NULL, 0);
+  if (argc > 2 || max_threads <= 0 || max_threads > MAX_THREADS)
+    usage(argv[0]);
+
+  double start = now();
+  for (int threads = 1; threads <= max_threads; threads *= 2) {
+    larson(threads);
+    xthread(threads);
+    cache_scratch(threads);
+    mstress(threads);
+  }
+  printf("%f\n", now() - start);
+
+  for (int i = 0; i < num_results; i++)
+    printf("%s %d %zu %f\n", results[i].scenario, results[i].threads, results[i].ops,
+           results[i].seconds);
+  return 0;
+}
@@ -1,452 +1,4333 @@
+#define _GNU_SOURCE
 #include <errno.h>
+#include <execinfo.h>
+#include <fcntl.h>
+#include <sched.h>
 #include <stdio.h>
+#include <stdarg.h>
+#include <stddef.h>
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include <stdbool.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
 #include <sys/mman.h>
 
 #include "mymalloc.h"
 
 
-// Header and Footer Block for size, last bit is allocation
+// Header of every block and footer of a free one: the size, and in the low
+// bits of a block in use, kInUse and kPrevInUse
 typedef struct MetaBlock {
   size_t size;
 } MetaBlock;
 
-// Pointer Block to link next/prev free block
+// Pointer Block to link next/prev free block, stored right after the
+// block's header so a list step reads the size and links from one line
 typedef struct PointerBlock {
   MetaBlock* prev;
   MetaBlock* next;
 } PointerBlock;
 
+// Tree Node to link a large free block into its arena's red-black tree,
+// stored after the header like a Pointer Block. Blocks with whole
+// pages that are still resident are also on the arena's dirty list, oldest
+// first, until they are purged
+typedef struct TreeNode {
+  MetaBlock* left;
+  MetaBlock* right;
+  MetaBlock* parent;
+  MetaBlock* dirtyPrev;
+  MetaBlock* dirtyNext;
+  uint64_t freedAt;
+  bool red;
+  bool dirty;
+} TreeNode;
 
-// Size of meta-data per free block
+
+// Size of meta-data per free block. Free blocks smaller than this, left
+// over when a block is cut to size, are fragments with only their tags
 const size_t kPointerBlockSize = 2*sizeof(MetaBlock) + sizeof(PointerBlock);
 
-// Size of meta-data per allocated block
-const size_t kMetaBlockSize = kPointerBlockSize - sizeof(PointerBlock);
+// Size of meta-data per allocated block, its header alone. A block in use
+// has no footer, its payload runs up to the next block's header
+const size_t kMetaBlockSize = sizeof(MetaBlock);
+
+// Bytes after a free block's header its list links or tree node may use
+const size_t kFreeLinksSize = sizeof(TreeNode);
+
+// Header bits of a block in use: the block itself is, and so is the block
+// on its left. Free blocks always have neighbours in use, as they are
+// coalesced, so their tags are plain sizes. Only a block in use whose left
+// neighbour is free reads that neighbour's footer
+const size_t kInUse = 1;
+const size_t kPrevInUse = 2;
+
+// Maximum allocation size, so sizes stay valid offsets. Huge blocks have
+// their own mappings, so the OS limits them well before this
+const size_t kMaxAllocationSize = PTRDIFF_MAX;
+
+// Block sizes, tags included, are multiples of this whatever the word
+// size, so the low bits of every header are free for tags and any tail cut
+// off a block has room for a header and footer. Payloads keep the 16 byte
+// alignment of the first one in a chunk
+#define BLOCK_ALIGNMENT 16
+const size_t kBlockAlignment = BLOCK_ALIGNMENT;
+
+// Slab objects at least this big are aligned to it. The drop-in build owes
+// callers libc's 16 byte alignment, otherwise the class spacing will do
+#ifdef MYMALLOC_PRELOAD
+const size_t kSlabAlignment = 16;
+#else
+const size_t kSlabAlignment = 8;
+#endif
+
+// Tag of the Fence-Posts at both ends of a chunk's blocks, in a bit no
+// block size sets, so blocks of any size are told apart from them
+#define FENCE_TAG 4
+const size_t kFence = FENCE_TAG;
+
+_Static_assert(FENCE_TAG < BLOCK_ALIGNMENT, "block sizes must leave the fence post bit clear");
+
+// Free lists form a two-level segregated fit index: each power of two is
+// split into SL_COUNT linear steps. FL_COUNT levels cover every block size
+// below 2^(FL_SHIFT + FL_COUNT - 1), larger blocks go in a tree instead
+#define SL_LOG2 3
+#define SL_COUNT (1 << SL_LOG2)
+#define FL_SHIFT (SL_LOG2 + 3)
+#define FL_COUNT 7
+
+_Static_assert(N_LISTS == FL_COUNT * SL_COUNT, "N_LISTS must cover every free list");
+
+// Sizes below this all share the first level
+const size_t kSmallBlockSize = 1 << FL_SHIFT;
+
+// Free blocks from this size up are kept in a tree ordered by size, then
+// address, and allocated from with best fit
+const size_t kLargeBlockSize = 1 << (FL_SHIFT + FL_COUNT - 1);
+
+// Pages of large free blocks are given back to the OS once the block has
+// stayed free this long (nanoseconds), so hot memory isn't churned
+const uint64_t kPurgeDelay = 1000000000ull;
+
+// Requests up to this size are served from slab runs, without boundary tags
+#define N_SLAB_CLASSES 32
+const size_t kSlabMaxSize = 256;
+
+// Slab size classes are spaced this far apart
+const size_t kSlabClassShift = 3;
+
+// A run is one page holding objects of a single slab class
+const size_t kRunSize = 4096;
+
+// Header at the start of each run, objects follow it. A set bit in the
+// bitmap marks a free object, so the first free one is found with ctz
+typedef struct Run {
+  struct Run* prev;
+  struct Run* next;
+  uint16_t sizeClass;
+  uint16_t nFree;
+  uint16_t nObjects;
+  uint64_t bitmap[8];
+} Run;
+
+// Objects start this far into their run, a multiple of kSlabMaxAlignment so
+// a class whose size is a multiple of an alignment up to it is aligned too
+const size_t kRunHeaderSize = (sizeof(Run) + 63) & ~(size_t) 63;
+
+// Largest alignment slab runs serve, one cache line
+const size_t kSlabMaxAlignment = 64;
+
+typedef enum ChunkKind {
+  // Boundary tagged blocks between two fence posts
+  BLOCK_CHUNK,
+  // kRunSize runs of slab objects, after a first page holding the header
+  SLAB_CHUNK,
+  // A single block filling its own page rounded mapping, unmapped on free
+  HUGE_CHUNK
+} ChunkKind;
+
+// Header at the start of every chunk, page map entries point here
+typedef struct Chunk {
+  struct Arena* arena;
+  size_t size;
+  ChunkKind kind;
+  // Taken from the page heap, and given back to it when unmapped
+  bool pooled;
+  // Block chunks only: no block starting at or past this address was ever
+  // handed out, so apart from free block links it still holds mmap's zeroes
+  size_t fresh;
+  // Huge chunks only: gap between the header and the left fence post that
+  // puts the block's payload at the alignment it was asked for
+  size_t lead;
+} Chunk;
+
+// Block chunks place their left fence post right after the header
+const size_t kChunkHeaderSize = (sizeof(Chunk) + 15) & ~(size_t) 15;
+
+// Runs a slab chunk is cut into, ARENA_SIZE / kRunSize
+#define SLAB_CHUNK_RUNS 1024
+
+// Slab chunks keep this after their header, on the page before their first
+// run: how many carved runs have no live objects, and which of those a trim
+// purged, taking them off the arena's empty list
+typedef struct SlabInfo {
+  size_t nEmpty;
+  size_t nPurged;
+  // Next slab chunk of the arena with purged runs
+  struct Chunk* nextPurged;
+  uint64_t purged[SLAB_CHUNK_RUNS / 64];
+} SlabInfo;
+
+// Counters an arena keeps as it works its free lists. Only written under the
+// arena's lock, so each update is a plain load and store, and read without it
+typedef struct ArenaStats {
+  atomic_size_t splits;
+  // Free neighbours merged into a freed block
+  atomic_size_t coalesces;
+  // Free list lookups, and the tree nodes and lists they visited
+  atomic_size_t searches;
+  atomic_size_t searchSteps;
+  // Bytes given back with madvise
+  atomic_size_t purged;
+} ArenaStats;
+
+// An independent heap: its own free lists, grown from its own chunks
+typedef struct Arena {
+  // Guards freeListArray and every free block threaded through it
+  pthread_mutex_t lock;
+  // Starting address of each free list, root
+  MetaBlock* freeListArray[N_LISTS];
+  // Bit per first level with any non-empty list, and per non-empty list
+  uint32_t flBitmap;
+  uint32_t slBitmap[FL_COUNT];
+  // Root of the red-black tree of large free blocks
+  MetaBlock* largeTree;
+  // Large free blocks whose pages are still resident, oldest first
+  MetaBlock* dirtyHead;
+  MetaBlock* dirtyTail;
+  // Block chunks mapped, the last one is kept even when empty
+  size_t nBlockChunks;
+  // Runs with both live and free objects, one list per slab class
+  Run* partialRuns[N_SLAB_CLASSES];
+  // Runs without live objects, ready to take any slab class, then slab
+  // chunks holding purged ones
+  Run* emptyRuns;
+  Chunk* purgedChunks;
+  // Slab chunk still being carved into runs, and its next unused run
+  Chunk* slabChunk;
+  size_t nextRun;
+  // Blocks freed by threads of other arenas, still marked allocated and
+  // linked through their first payload word. Pushed with a CAS, collected
+  // in bulk by this arena's next slow-path my_malloc
+  _Atomic(void*) remoteFrees;
+  // On a line of its own, which also pads the arena so the next one's lock
+  // doesn't share it
+  _Alignas(64) ArenaStats stats;
+} Arena;
+
+// Upper bound on arenas, the default is one per online core
+#define MAX_ARENAS 256
+
+static Arena arenas[MAX_ARENAS];
+static int nArenas;
+static int nCpus;
+static pthread_once_t arenasOnce = PTHREAD_ONCE_INIT;
+
+// Hands out arenas to threads whose CPU is unknown
+static atomic_uint nextArena;
+
+// Requests from this size up get a huge chunk of their own instead of a
+// block from the free lists, MYMALLOC_MMAP_THRESHOLD overrides it
+static size_t hugeThreshold = ARENA_SIZE / 4;
+
+// Granularity of huge chunk mappings
+const size_t kPageSize = 4096;
+
+// Transparent huge page size. Chunks are ARENA_SIZE aligned, so a chunk is
+// made of whole huge pages
+const size_t kHugePageSize = 2ull << 20;
+
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+
+// How chunks are backed, MYMALLOC_THP picks one: plain pages, "madvise" (or
+// "1") asks for transparent huge pages, "hugetlb" maps block and slab chunks
+// from the reserved huge page pool, falling back to madvise when it is empty
+typedef enum HugePageMode {
+  HUGE_PAGES_OFF,
+  HUGE_PAGES_MADVISE,
+  HUGE_PAGES_HUGETLB
+} HugePageMode;
+
+static HugePageMode hugePages = HUGE_PAGES_OFF;
+
+// Free pages are given back in runs aligned to this, kHugePageSize whenever
+// huge pages are on so purging never splits one
+static size_t purgeGrain = kPageSize;
+
+// Chunks are mapped ARENA_SIZE aligned, so each ARENA_SIZE window of the
+// address space belongs to at most one chunk. A three level radix tree, two
+// levels keyed by window number and a leaf per window, maps the pages of
+// every chunk to an entry naming the chunk, its kind, its arena and, for
+// slab runs, their size class. Frees find their owner and class from the
+// entry alone, and pointers into no page of ours are turned away without
+// reading the memory around them
+#define CHUNK_SHIFT 22
+#define PAGE_SHIFT 12
+#define PAGE_BITS (CHUNK_SHIFT - PAGE_SHIFT)
+#define MAP_BITS ((sizeof(void*) == 8 ? 48 : 32) - CHUNK_SHIFT)
+#define MAP_LEAF_BITS (MAP_BITS < 13 ? MAP_BITS : 13)
+#define MAP_ROOT_BITS (MAP_BITS - MAP_LEAF_BITS)
+
+// The chunk's address, whose low CHUNK_SHIFT bits are clear, with its kind
+// in bits 0-1, the slab class plus one (0 for none) in bits 2-7 and the
+// index of its arena in bits 8-15. Zero for a page of no chunk
+typedef size_t PageEntry;
+
+#define ENTRY_CLASS_SHIFT 2
+#define ENTRY_ARENA_SHIFT 8
+
+_Static_assert(N_SLAB_CLASSES < (1 << (ENTRY_ARENA_SHIFT - ENTRY_CLASS_SHIFT)), "slab classes must fit a page entry");
+_Static_assert(MAX_ARENAS <= (1 << (CHUNK_SHIFT - ENTRY_ARENA_SHIFT)), "arena indices must fit a page entry");
+
+typedef struct PageMapLeaf {
+  _Atomic(PageEntry) pages[1 << PAGE_BITS];
+} PageMapLeaf;
+
+typedef struct PageMapNode {
+  _Atomic(PageMapLeaf*) windows[1 << MAP_LEAF_BITS];
+} PageMapNode;
+
+static _Atomic(PageMapNode*) pageMap[1 << MAP_ROOT_BITS];
+
+// Leaves are carved from mappings of this many, untouched until used, so a
+// growing heap doesn't pay an mmap per window
+#define LEAF_BATCH 64
+
+static PageMapLeaf* freeLeaves;
+static size_t nFreeLeaves;
+
+// Serialises creation of page map nodes and leaves, lookups never lock
+static pthread_mutex_t pageMapLock = PTHREAD_MUTEX_INITIALIZER;
+
+// Thread caches hold blocks below this size, binned by 16 byte steps
+#define N_CACHE_BINS 64
+const size_t kCacheBinShift = 4;
+
+// Blocks moved between a thread cache bin and the free lists at once
+const int kCacheBatch = 8;
+
+// Most blocks a single thread cache bin may hold before flushing
+const int kCacheBinMax = 32;
+
+// Allocations are counted in bins: one per slab class, one per cache bin of
+// blocks, then all larger blocks and all huge blocks
+#define N_STAT_BINS (N_SLAB_CLASSES + N_CACHE_BINS + 2)
+#define STAT_LARGE (N_SLAB_CLASSES + N_CACHE_BINS)
+#define STAT_HUGE (STAT_LARGE + 1)
+
+// Allocations and frees of one stats bin, and their usable bytes
+typedef struct BinStats {
+  atomic_size_t nmalloc;
+  atomic_size_t nfree;
+  atomic_size_t allocated;
+  atomic_size_t freed;
+} BinStats;
+
+// Counters of the thread holding this slot, written by it alone. Slots are
+// never unmapped: an exiting thread hands its slot to the next new one,
+// which keeps counting in it, so totals are sums over every slot
+typedef struct ThreadStats {
+  BinStats bins[N_STAT_BINS];
+  // Every slot ever mapped
+  struct ThreadStats* next;
+  // Slots no thread holds
+  struct ThreadStats* nextFree;
+} ThreadStats;
+
+static _Atomic(ThreadStats*) allStats;
+static ThreadStats* freeStats;
+static pthread_mutex_t statsLock = PTHREAD_MUTEX_INITIALIZER;
+
+// Shared by threads that couldn't map a slot, updates may then be lost
+static ThreadStats spareStats;
+
+// Mapping counters, chunk bytes are kept per ChunkKind
+static atomic_size_t mappedBytes[3];
+static atomic_size_t nMmaps;
+static atomic_size_t nMunmaps;
+static atomic_size_t nMremaps;
+
+// Address space the page heap reserves from the OS at a time matches what it
+// has reserved so far, so reservations double, up to this
+const size_t kMaxReserve = 64ull << 20;
+
+// Free spans the page heap tracks, others go back to the OS
+#define PAGE_HEAP_SPANS 256
+
+// ARENA_SIZE aligned address space between chunks. Its pages are purged, so
+// it reads as zero like a fresh mapping
+typedef struct PageSpan {
+  size_t start;
+  size_t size;
+} PageSpan;
+
+// Central page heap: every arena takes its block and slab chunks from it and
+// gives emptied ones back, so a chunk freed by one arena serves the next one
+// any arena needs. Free spans are kept in address order, coalesced
+static PageSpan freeSpans[PAGE_HEAP_SPANS];
+static size_t nFreeSpans;
+static size_t reservedBytes;
+static atomic_size_t retainedBytes;
+static pthread_mutex_t pageHeapLock = PTHREAD_MUTEX_INITIALIZER;
+
+// Records a thread buffers before appending them to the trace file
+#define TRACE_RECORDS 1024
+
+// A thread's trace records not yet written. Buffers are never unmapped, an
+// exiting thread hands its buffer to the next new one
+typedef struct TraceBuffer {
+  my_trace_record records[TRACE_RECORDS];
+  // Written by the owner only, read by the final flush at exit
+  atomic_size_t count;
+  // Every buffer ever mapped
+  struct TraceBuffer* next;
+  // Buffers no thread holds
+  struct TraceBuffer* nextFree;
+} TraceBuffer;
+
+// Trace file, -1 unless MYMALLOC_TRACE named one. Writes to it, and both
+// buffer lists, are guarded by traceLock
+static atomic_int traceFd = -1;
+static TraceBuffer* allTraces;
+static TraceBuffer* freeTraces;
+static pthread_mutex_t traceLock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t traceStart;
+static atomic_uint_fast64_t traceSeq;
+static atomic_uint traceThreads;
+
+// Frames kept of a sampled allocation's stack
+#define PROF_FRAMES 32
+// Distinct stacks the profiler keeps, later ones share the last
+#define PROF_STACKS 4096
+#define PROF_STACK_BUCKETS 1024
+// Live samples are looked up in sets of 8 slots, a cache line of keys
+#define PROF_SLOTS (1 << 15)
+#define PROF_WAYS 8
+
+// An allocation site of the heap profile, and what was sampled there
+typedef struct ProfStack {
+  void* frames[PROF_FRAMES];
+  int depth;
+  size_t liveCount;
+  size_t liveBytes;
+  size_t allocCount;
+  size_t allocBytes;
+  struct ProfStack* next;
+} ProfStack;
+
+// Mean bytes between samples, 0 unless MYMALLOC_PROF_SAMPLE is set
+static size_t profInterval;
+// Stacks, and the set of live sampled blocks, guarded by profLock. Frees
+// look their block up without the lock, and only if anything is sampled
+static ProfStack profStacks[PROF_STACKS];
+static ProfStack* profBuckets[PROF_STACK_BUCKETS];
+static int nProfStacks;
+static _Atomic(void*) sampleKeys[PROF_SLOTS];
+static ProfStack* sampleStacks[PROF_SLOTS];
+static size_t sampleSizes[PROF_SLOTS];
+static atomic_size_t nSamples;
+static pthread_mutex_t profLock = PTHREAD_MUTEX_INITIALIZER;
+
+// Cached blocks and slab objects stay allocated, their first word links the
+// stack and the second, bar in 8 byte slab objects, holds cacheCookie
+typedef struct CacheBin {
+  void* head;
+  int count;
+} CacheBin;
+
+// Per-thread stacks of recently freed slab objects, one per slab class, and
+// of blocks, one per 16 byte size class
+typedef struct ThreadCache {
+  CacheBin slabBins[N_SLAB_CLASSES];
+  CacheBin bins[N_CACHE_BINS];
+  // Arena this thread allocates from, every cached block belongs to it
+  Arena* arena;
+  ThreadStats* stats;
+  TraceBuffer* trace;
+  uint32_t traceThread;
+  // Bytes this thread allocates before its next sample
+  ptrdiff_t sampleLeft;
+  uint64_t sampleSeed;
+  bool sampling;
+  bool registered;
+} ThreadCache;
+
+// Initial-exec TLS is resolved at load time, so reaching the cache never
+// calls __tls_get_addr, which may itself allocate
+static __thread ThreadCache threadCache __attribute__((tls_model("initial-exec")));
+
+// Key whose destructor drains a thread's cache when it exits
+static pthread_key_t cacheKey;
+static pthread_once_t cacheKeyOnce = PTHREAD_ONCE_INIT;
+
+// Written after the link of an object in a thread cache bin, so an object
+// freed again while cached is caught, as it is once back in its arena.
+// Random, so live data that happens to match it is rare, and only costs a
+// search of the bin
+static uintptr_t cacheCookie;
+
+// Written after the link of an object pushed onto another arena's remote
+// free list, where it still looks allocated, so freeing it again is caught
+// before the list can take it twice
+static uintptr_t remoteCookie;
+
+// Set by whichever thread registers the fork handlers. Not a pthread_once,
+// pthread_atfork may allocate and must not wait on itself
+static atomic_bool forkHandlersSet;
+
+// Align sizes for faster operations
+inline static size_t round_up(size_t size, size_t alignment) {
+  const size_t mask = alignment - 1;
+  return (size + mask) & ~mask;
+}
+
+/*
+* Adds "n" to a counter that only one thread writes at a time
+*/
+inline static void addStat(atomic_size_t* counter, size_t n) {
+  atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + n,
+                        memory_order_relaxed);
+}
+
+/*
+* Maps "size" bytes of zeroed memory with extra mmap "flags", MAP_FAILED if
+* that fails
+*/
+void* mapPagesWith(size_t size, int flags) {
+  atomic_fetch_add_explicit(&nMmaps, 1, memory_order_relaxed);
+  return mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+}
+
+/*
+* Maps "size" bytes of zeroed memory, MAP_FAILED if that fails
+*/
+void* mapPages(size_t size) {
+  return mapPagesWith(size, 0);
+}
+
+/*
+* Unmaps "size" bytes from "start"
+*/
+void unmapPages(void* start, size_t size) {
+  atomic_fetch_add_explicit(&nMunmaps, 1, memory_order_relaxed);
+  munmap(start, size);
+}
+
+/*
+* Writes all "len" bytes of "buf" to "fd", short of an error
+*/
+void writeAll(int fd, const void* buf, size_t len) {
+  for (size_t done = 0; done < len; ) {
+    ssize_t n = write(fd, ((const char*) buf) + done, len - done);
+    if (n <= 0) {
+      break;
+    }
+    done += n;
+  }
+}
+
+/*
+* Returns the page map leaf of the window "addr" lies in, or NULL if there
+* is none. With "create", a missing leaf, and the node above it, is mapped
+* first, NULL then meaning that failed
+*/
+PageMapLeaf* getLeaf(size_t addr, bool create) {
+  size_t key = addr >> CHUNK_SHIFT;
+  size_t rootIdx = key >> MAP_LEAF_BITS;
+  size_t windowIdx = key & ((1 << MAP_LEAF_BITS) - 1);
+  if (rootIdx >= (1ull << MAP_ROOT_BITS)) {
+    return NULL;
+  }
+
+  PageMapNode* node = atomic_load_explicit(&pageMap[rootIdx], memory_order_acquire);
+  PageMapLeaf* leaf = node == NULL ? NULL : atomic_load_explicit(&node->windows[windowIdx], memory_order_acquire);
+  if (leaf != NULL || !create) {
+    return leaf;
+  }
+
+  // Nodes and leaves are only ever added, so missing ones are created under
+  // the lock
+  pthread_mutex_lock(&pageMapLock);
+  node = atomic_load_explicit(&pageMap[rootIdx], memory_order_relaxed);
+  if (node == NULL) {
+    node = mapPages(sizeof(PageMapNode));
+    if (node == MAP_FAILED) {
+      pthread_mutex_unlock(&pageMapLock);
+      return NULL;
+    }
+    atomic_store_explicit(&pageMap[rootIdx], node, memory_order_release);
+  }
+  leaf = atomic_load_explicit(&node->windows[windowIdx], memory_order_relaxed);
+  if (leaf == NULL) {
+    if (nFreeLeaves == 0) {
+      freeLeaves = mapPages(LEAF_BATCH * sizeof(PageMapLeaf));
+      if (freeLeaves == MAP_FAILED) {
+        pthread_mutex_unlock(&pageMapLock);
+        return NULL;
+      }
+      nFreeLeaves = LEAF_BATCH;
+    }
+    leaf = freeLeaves++;
+    nFreeLeaves--;
+    atomic_store_explicit(&node->windows[windowIdx], leaf, memory_order_release);
+  }
+  pthread_mutex_unlock(&pageMapLock);
+  return leaf;
+}
+
+/*
+* Returns the page map entry of the page "ptr" lies in, 0 if no chunk of
+* ours covers it
+*/
+PageEntry getEntry(void* ptr) {
+  PageMapLeaf* leaf = getLeaf((size_t) ptr, false);
+  if (leaf == NULL) {
+    return 0;
+  }
+  return atomic_load_explicit(&leaf->pages[(((size_t) ptr) >> PAGE_SHIFT) & ((1 << PAGE_BITS) - 1)], memory_order_relaxed);
+}
+
+inline static Chunk* entryChunk(PageEntry entry) {
+  return (Chunk*) (entry & ~((1ull << CHUNK_SHIFT) - 1));
+}
+
+inline static ChunkKind entryKind(PageEntry entry) {
+  return (ChunkKind) (entry & ((1 << ENTRY_CLASS_SHIFT) - 1));
+}
+
+/*
+* Returns the slab class of the run an entry's page holds, -1 if it holds none
+*/
+inline static int entrySlabClass(PageEntry entry) {
+  return (int) ((entry >> ENTRY_CLASS_SHIFT) & ((1 << (ENTRY_ARENA_SHIFT - ENTRY_CLASS_SHIFT)) - 1)) - 1;
+}
+
+inline static Arena* entryArena(PageEntry entry) {
+  return &arenas[(entry >> ENTRY_ARENA_SHIFT) & (MAX_ARENAS - 1)];
+}
+
+/*
+* Returns the chunk "ptr" lies in, or NULL if no chunk of ours covers it
+*/
+Chunk* getChunk(void* ptr) {
+  return entryChunk(getEntry(ptr));
+}
+
+/*
+* Builds the entry for a page of "chunk" holding a run of "sizeClass", -1
+* for none
+*/
+PageEntry makeEntry(Chunk* chunk, int sizeClass) {
+  return ((size_t) chunk) | chunk->kind | ((size_t) (sizeClass + 1) << ENTRY_CLASS_SHIFT) |
+         ((size_t) (chunk->arena - arenas) << ENTRY_ARENA_SHIFT);
+}
+
+/*
+* Returns the end of the pages of "chunk" the page map covers: all of them,
+* bar for huge chunks, which only need theirs up to the page holding the
+* payload, however far they have grown past it
+*/
+size_t chunkMapEnd(Chunk* chunk) {
+  if (chunk->kind == HUGE_CHUNK) {
+    size_t payload = ((size_t) chunk) + kChunkHeaderSize + chunk->lead + 2*sizeof(MetaBlock);
+    return round_up(payload + 1, kPageSize);
+  }
+  return ((size_t) chunk) + chunk->size;
+}
+
+/*
+* Sets the entry of every page from "start" to "end" to "entry". Leaves are
+* only created for a non-zero entry, returns false if one can't be
+*/
+bool setPages(size_t start, size_t end, PageEntry entry) {
+  for (size_t page = start; page < end; ) {
+    size_t windowEnd = (page | ((1ull << CHUNK_SHIFT) - 1)) + 1;
+    PageMapLeaf* leaf = getLeaf(page, entry != 0);
+    if (leaf == NULL) {
+      if (entry != 0) {
+        return false;
+      }
+      page = windowEnd;
+      continue;
+    }
+    for (; page < end && page < windowEnd; page += kPageSize) {
+      atomic_store_explicit(&leaf->pages[(page >> PAGE_SHIFT) & ((1 << PAGE_BITS) - 1)], entry, memory_order_relaxed);
+    }
+  }
+  return true;
+}
+
+/*
+* Points the pages of "chunk" at its header in the page map, slab pages
+* without a run for now
+*/
+bool setChunk(Chunk* chunk) {
+  return setPages((size_t) chunk, chunkMapEnd(chunk), makeEntry(chunk, -1));
+}
+
+/*
+* Drops the pages of "chunk" out of the page map
+*/
+void clearChunk(Chunk* chunk) {
+  setPages((size_t) chunk, chunkMapEnd(chunk), 0);
+}
+
+/*
+* Records in the page map that the page of "run" holds objects of
+* "sizeClass". Caller must hold the lock of the run's arena
+*/
+void setRunClass(Run* run, int sizeClass) {
+  PageEntry entry = getEntry(run);
+  entry &= ~(((1ull << ENTRY_ARENA_SHIFT) - 1) & ~((1ull << ENTRY_CLASS_SHIFT) - 1));
+  setPages((size_t) run, ((size_t) run) + kRunSize, entry | ((size_t) (sizeClass + 1) << ENTRY_CLASS_SHIFT));
+}
+
+/*
+* Maps "size" bytes aligned to ARENA_SIZE, by trimming a larger mapping.
+* With "flags" MAP_HUGETLB the mapping and every trim are whole huge pages
+*/
+void* mapChunk(size_t size, int flags) {
+  char* raw = mapPagesWith(size + ARENA_SIZE, flags);
+  if (raw == MAP_FAILED) {
+    return NULL;
+  }
+
+  size_t lead = round_up((size_t) raw, ARENA_SIZE) - (size_t) raw;
+  if (lead > 0) {
+    unmapPages(raw, lead);
+  }
+  unmapPages(raw + lead + size, ARENA_SIZE - lead);
+
+  return raw + lead;
+}
+
+/*
+* Files the free span at "start" in address order, merged with the spans
+* either side of it. Returns false if it touches neither and the table is
+* full. Caller must hold pageHeapLock
+*/
+bool insertSpan(size_t start, size_t size) {
+  size_t i = 0;
+  while (i < nFreeSpans && freeSpans[i].start < start) {
+    i++;
+  }
+  bool left = i > 0 && freeSpans[i - 1].start + freeSpans[i - 1].size == start;
+  bool right = i < nFreeSpans && start + size == freeSpans[i].start;
+
+  if (left && right) {
+    freeSpans[i - 1].size += size + freeSpans[i].size;
+    memmove(&freeSpans[i], &freeSpans[i + 1], (nFreeSpans - i - 1) * sizeof(PageSpan));
+    nFreeSpans--;
+  } else if (left) {
+    freeSpans[i - 1].size += size;
+  } else if (right) {
+    freeSpans[i].start = start;
+    freeSpans[i].size += size;
+  } else if (nFreeSpans < PAGE_HEAP_SPANS) {
+    memmove(&freeSpans[i + 1], &freeSpans[i], (nFreeSpans - i) * sizeof(PageSpan));
+    freeSpans[i] = (PageSpan) {start, size};
+    nFreeSpans++;
+  } else {
+    return false;
+  }
+  atomic_fetch_add_explicit(&retainedBytes, size, memory_order_relaxed);
+  return true;
+}
+
+/*
+* Takes "size" bytes, a multiple of ARENA_SIZE, of aligned zeroed address
+* space from the lowest free span of the page heap that fits, reserving more
+* from the OS if none does. Returns NULL if that fails
+*/
+void* takeSpan(size_t size) {
+  pthread_mutex_lock(&pageHeapLock);
+  for (size_t i = 0; i < nFreeSpans; i++) {
+    if (freeSpans[i].size >= size) {
+      void* span = (void*) freeSpans[i].start;
+      freeSpans[i].start += size;
+      freeSpans[i].size -= size;
+      if (freeSpans[i].size == 0) {
+        memmove(&freeSpans[i], &freeSpans[i + 1], (nFreeSpans - i - 1) * sizeof(PageSpan));
+        nFreeSpans--;
+      }
+      atomic_fetch_sub_explicit(&retainedBytes, size, memory_order_relaxed);
+      pthread_mutex_unlock(&pageHeapLock);
+      return span;
+    }
+  }
+
+  size_t reserve = reservedBytes < kMaxReserve ? reservedBytes : kMaxReserve;
+  if (reserve < size) {
+    reserve = size;
+  }
+  char* span = mapChunk(reserve, 0);
+  if (span == NULL && reserve > size) {
+    reserve = size;
+    span = mapChunk(reserve, 0);
+  }
+  if (span != NULL) {
+    reservedBytes += reserve;
+    if (reserve > size && !insertSpan(((size_t) span) + size, reserve - size)) {
+      reservedBytes -= reserve - size;
+      unmapPages(span + size, reserve - size);
+    }
+  }
+  pthread_mutex_unlock(&pageHeapLock);
+  return span;
+}
+
+/*
+* Purges the span of a chunk no longer used and gives it back to the page
+* heap, or to the OS if the page heap can't track it
+*/
+void giveSpan(void* start, size_t size) {
+  madvise(start, size, MADV_DONTNEED);
+  pthread_mutex_lock(&pageHeapLock);
+  bool kept = insertSpan((size_t) start, size);
+  if (!kept) {
+    reservedBytes -= size;
+  }
+  pthread_mutex_unlock(&pageHeapLock);
+  if (!kept) {
+    unmapPages(start, size);
+  }
+}
+
+/*
+* Maps and registers a chunk of "size" bytes for "arena", header filled in.
+* Block and slab chunks come from the page heap, huge chunks, which can be
+* resized in place, have mappings of their own
+*/
+Chunk* newChunk(Arena* arena, size_t size, ChunkKind kind) {
+  Chunk* chunk = NULL;
+  bool pooled = false;
+  if (hugePages == HUGE_PAGES_HUGETLB && kind != HUGE_CHUNK) {
+    chunk = mapChunk(size, MAP_HUGETLB | MAP_HUGE_2MB);
+  }
+  if (chunk == NULL) {
+    pooled = kind != HUGE_CHUNK;
+    chunk = pooled ? takeSpan(size) : mapChunk(size, 0);
+    if (chunk == NULL) {
+      return NULL;
+    }
+    if (hugePages != HUGE_PAGES_OFF) {
+      madvise(chunk, size, MADV_HUGEPAGE);
+    }
+  }
+
+  chunk->arena = arena;
+  chunk->size = size;
+  chunk->kind = kind;
+  chunk->pooled = pooled;
+
+  if (!setChunk(chunk)) {
+    if (pooled) {
+      giveSpan(chunk, size);
+    } else {
+      unmapPages(chunk, size);
+    }
+    return NULL;
+  }
+  atomic_fetch_add_explicit(&mappedBytes[kind], size, memory_order_relaxed);
+  return chunk;
+}
+
+/*
+* Drops "chunk" from the page map and gives it back to the page heap it came
+* from, or to the OS
+*/
+void unmapChunk(Chunk* chunk) {
+  atomic_fetch_sub_explicit(&mappedBytes[chunk->kind], chunk->size, memory_order_relaxed);
+  clearChunk(chunk);
+  if (chunk->pooled) {
+    giveSpan(chunk, chunk->size);
+  } else {
+    unmapPages(chunk, chunk->size);
+  }
+}
+
+/*
+* Resizes "chunk" to "size" bytes without copying it: in place if it shrinks
+* or the address space after it is free, otherwise by moving its pages onto
+* a new aligned range. Returns the chunk's new address, or NULL if it is left
+* unchanged
+*/
+Chunk* remapChunk(Chunk* chunk, size_t size) {
+  size_t oldSize = chunk->size;
+
+  // The page map only covers the pages up to the payload, which stay put
+  atomic_fetch_add_explicit(&nMremaps, 1, memory_order_relaxed);
+  if (mremap(chunk, oldSize, size, 0) != MAP_FAILED) {
+    chunk->size = size;
+    atomic_fetch_add_explicit(&mappedBytes[chunk->kind], size - oldSize, memory_order_relaxed);
+    return chunk;
+  }
+
+  // Register the new range before moving, and drop the old one before it
+  // can be unmapped and reused by another chunk
+  Chunk* dest = mapChunk(size, 0);
+  if (dest == NULL) {
+    return NULL;
+  }
+  *dest = *chunk;
+  dest->size = size;
+  if (!setChunk(dest)) {
+    clearChunk(dest);
+    unmapPages(dest, size);
+    return NULL;
+  }
+  clearChunk(chunk);
+
+  atomic_fetch_add_explicit(&nMremaps, 1, memory_order_relaxed);
+  if (mremap(chunk, oldSize, size, MREMAP_MAYMOVE | MREMAP_FIXED, dest) == MAP_FAILED) {
+    // Leaves for the old pages are still there, so this can't fail
+    setChunk(chunk);
+    clearChunk(dest);
+    unmapPages(dest, size);
+    return NULL;
+  }
+
+  // The moved header still holds the old size
+  dest->size = size;
+  atomic_fetch_add_explicit(&mappedBytes[dest->kind], size - oldSize, memory_order_relaxed);
+  return dest;
+}
+
+/*
+* Fills "chunk" with a single allocated block between its two fence posts,
+* as huge chunks hold, and returns the block
+*/
+MetaBlock* fillChunk(Chunk* chunk) {
+  MetaBlock* leftFence = (MetaBlock*) (((size_t) chunk) + kChunkHeaderSize + chunk->lead);
+  leftFence->size = kFence;
+
+  MetaBlock* curr = leftFence + 1;
+  size_t span = chunk->size - kChunkHeaderSize - chunk->lead - 2*sizeof(MetaBlock);
+  curr->size = span | kInUse | kPrevInUse;
+  ((MetaBlock*) (((size_t) curr) + span))->size = kFence;
+
+  // The block is handed out whole
+  chunk->fresh = ((size_t) chunk) + chunk->size;
+  return curr;
+}
+
+/*
+* Returns the page rounded size of a huge chunk holding a "size" byte request
+* after a "lead" byte gap
+*/
+size_t hugeChunkSize(size_t size, size_t lead) {
+  return round_up(size + kMetaBlockSize + kChunkHeaderSize + lead + 2*sizeof(MetaBlock), kPageSize);
+}
+
+/*
+* Given a (presumed) free block's LEFT metadata block, finds the pointer block
+*/
+PointerBlock* getPointers(MetaBlock* block) {
+  if (block == NULL) {
+    return NULL;
+  }
 
-// Maximum allocation size (16 MB)
-const size_t kMaxAllocationSize = (16ull << 20) - kMetaBlockSize;
+  // Pointers follow the header, on its cache line
+  PointerBlock* outpp = (PointerBlock*) (((size_t) block) + sizeof(MetaBlock));
 
-// Dummy value for size used in Fence-Posts
-const size_t kMemorySize = (16ull << 22);
+  return outpp;
+}
 
-// Starting address of our heap, root
-static MetaBlock* freeListArray[8];
+/*
+* Given a large free block's LEFT metadata block, finds its tree node
+*/
+TreeNode* getNode(MetaBlock* block) {
+  // The node follows the header, like a Pointer Block
+  return (TreeNode*) (((size_t) block) + sizeof(MetaBlock));
+}
+
+/*
+* Initialise free block for all space as a single free block, in a new chunk
+* owned by "arena"
+*/
+MetaBlock* initialise(Arena* arena, int m) {
+  // Allocating Initial Memory
+  Chunk* chunk = newChunk(arena, m*ARENA_SIZE, BLOCK_CHUNK);
+
+  if (chunk == NULL) {
+    return NULL;
+  }
+  arena->nBlockChunks++;
+
+  // Init is left most, indicated by kFence
+  MetaBlock* init = (MetaBlock*) (((size_t) chunk) + kChunkHeaderSize);
+  chunk->fresh = ((size_t) init) + sizeof(MetaBlock);
+  size_t span = m*ARENA_SIZE - kChunkHeaderSize;
+  init->size = kFence;
+
+  // Go to the end, subtract Metablock for right_fp
+  MetaBlock* right_fp = (MetaBlock*) (((size_t) init) + span - sizeof(MetaBlock));
+  right_fp->size = kFence;
+
+  // Freelist starts after left_fp
+  init = (MetaBlock*) (((size_t) init) + sizeof(MetaBlock));
+  init->size = span - 2*sizeof(MetaBlock);
+
+  // Specify pointers, since it is free, both to NULL
+  PointerBlock* init_ptr = getPointers(init);
+  init_ptr->prev = NULL;
+  init_ptr->next = NULL;
+
+
+  // Add footer tag
+  MetaBlock* freeListEnd = (MetaBlock*) (((size_t) init) + init->size - sizeof(MetaBlock));
+  freeListEnd->size = span - 2*sizeof(MetaBlock);
+
+  return init;
+}
+
+/*
+* Given the left metadata block, returns the right metadata block
+* Assumes that the block is unallocated
+*/
+MetaBlock* getRightMetaBlock(MetaBlock* block) {
+  if (block == NULL) {
+    return NULL;
+  }
+
+  // Adding size to go to end, then taking away MetaBlock size
+  MetaBlock* new = (MetaBlock*) (((size_t) block) + block->size - sizeof(MetaBlock));
+  return new;
+}
+
+/*
+* Returns the size of a block from its header, without the bits in use
+*/
+inline static size_t tagSize(MetaBlock* block) {
+  return block->size & ~(kInUse | kPrevInUse);
+}
+
+/*
+* Records in "next", the block right of one that was just allocated or
+* freed, whether that block is now in use. Only blocks in use keep the bit,
+* so free blocks and fence posts are left alone
+*/
+inline static void setPrevInUse(MetaBlock* next, bool inUse) {
+  if (next->size & kInUse) {
+    next->size = inUse ? next->size | kPrevInUse : next->size & ~kPrevInUse;
+  }
+}
+
+/*
+* Splits a large block "curr" of "arena" into 2 blocks, where "size" is the
+* size of the first block. Only updates the tags of the second block
+*/
+MetaBlock* splitBlock(Arena* arena, MetaBlock* curr, size_t size) {
+  size_t size_before = curr->size;
+  addStat(&arena->stats.splits, 1);
+
+  // Finding second block
+  MetaBlock* newBlock = (MetaBlock*) (((size_t) curr) + size);
+
+  // Updating boundary tags for second block only
+  newBlock->size = size_before - size;
+  MetaBlock* newBlockRight = getRightMetaBlock(newBlock);
+  newBlockRight->size = size_before - size;
+
+  return newBlock;
+}
+
+/*
+* Returns the index of the most significant set bit of "x"
+*/
+inline static int msb(size_t x) {
+  return (int) (sizeof(size_t) * 8 - 1) - __builtin_clzl(x);
+}
+
+/*
+* Maps a block size to its free list: the first level is the power of two
+* below it, the second level one of SL_COUNT linear steps within it. Sizes
+* below kSmallBlockSize all share first level 0, one step per 8 bytes
+*/
+int getIndex(size_t size) {
+  if (size < kSmallBlockSize) {
+    return size >> 3;
+  }
+  int bit = msb(size);
+  int fl = bit - FL_SHIFT + 1;
+  int sl = (size >> (bit - SL_LOG2)) & (SL_COUNT - 1);
+  return fl * SL_COUNT + sl;
+}
+
+/*
+* Rounds a request up to the first size of the next free list, so every block
+* in the list getIndex() then picks is big enough
+*/
+size_t roundToList(size_t size) {
+  if (size < kSmallBlockSize) {
+    return round_up(size, 8);
+  }
+  return round_up(size, (size_t) 1 << (msb(size) - SL_LOG2));
+}
+
+/*
+* Tree order: by size, then by address so ties resolve to the lowest block
+*/
+bool treeLess(MetaBlock* a, MetaBlock* b) {
+  return a->size < b->size || (a->size == b->size && a < b);
+}
+
+bool isRed(MetaBlock* block) {
+  return block != NULL && getNode(block)->red;
+}
+
+/*
+* Replaces the subtree at "old" with the one at "new" in its parent
+*/
+void treeReplace(Arena* arena, MetaBlock* old, MetaBlock* new) {
+  MetaBlock* parent = getNode(old)->parent;
+  if (parent == NULL) {
+    arena->largeTree = new;
+  } else if (getNode(parent)->left == old) {
+    getNode(parent)->left = new;
+  } else {
+    getNode(parent)->right = new;
+  }
+  if (new != NULL) {
+    getNode(new)->parent = parent;
+  }
+}
+
+/*
+* Rotates "x" down to the left, its right child takes its place
+*/
+void rotateLeft(Arena* arena, MetaBlock* x) {
+  TreeNode* xNode = getNode(x);
+  MetaBlock* y = xNode->right;
+  TreeNode* yNode = getNode(y);
+
+  xNode->right = yNode->left;
+  if (yNode->left != NULL) {
+    getNode(yNode->left)->parent = x;
+  }
+  treeReplace(arena, x, y);
+  yNode->left = x;
+  xNode->parent = y;
+}
+
+/*
+* Rotates "x" down to the right, its left child takes its place
+*/
+void rotateRight(Arena* arena, MetaBlock* x) {
+  TreeNode* xNode = getNode(x);
+  MetaBlock* y = xNode->left;
+  TreeNode* yNode = getNode(y);
+
+  xNode->left = yNode->right;
+  if (yNode->right != NULL) {
+    getNode(yNode->right)->parent = x;
+  }
+  treeReplace(arena, x, y);
+  yNode->right = x;
+  xNode->parent = y;
+}
+
+/*
+* Adds a large free block to the tree, then recolours and rotates back up to
+* restore the red-black invariants
+*/
+void treeInsert(Arena* arena, MetaBlock* block) {
+  MetaBlock* parent = NULL;
+  MetaBlock* curr = arena->largeTree;
+  while (curr != NULL) {
+    parent = curr;
+    curr = treeLess(block, curr) ? getNode(curr)->left : getNode(curr)->right;
+  }
+
+  TreeNode* node = getNode(block);
+  node->left = NULL;
+  node->right = NULL;
+  node->parent = parent;
+  node->red = true;
+  node->dirty = false;
+  if (parent == NULL) {
+    arena->largeTree = block;
+  } else if (treeLess(block, parent)) {
+    getNode(parent)->left = block;
+  } else {
+    getNode(parent)->right = block;
+  }
+
+  // A red block may not have a red parent
+  while (isRed(getNode(block)->parent)) {
+    parent = getNode(block)->parent;
+    MetaBlock* grandparent = getNode(parent)->parent;
+    bool parentIsLeft = getNode(grandparent)->left == parent;
+    MetaBlock* uncle = parentIsLeft ? getNode(grandparent)->right : getNode(grandparent)->left;
+
+    if (isRed(uncle)) {
+      // Push the grandparent's black down a level and continue from it
+      getNode(parent)->red = false;
+      getNode(uncle)->red = false;
+      getNode(grandparent)->red = true;
+      block = grandparent;
+      continue;
+    }
+
+    // Rotate an inner grandchild to the outside first
+    if (parentIsLeft && block == getNode(parent)->right) {
+      rotateLeft(arena, parent);
+      block = parent;
+      parent = getNode(block)->parent;
+    } else if (!parentIsLeft && block == getNode(parent)->left) {
+      rotateRight(arena, parent);
+      block = parent;
+      parent = getNode(block)->parent;
+    }
+
+    getNode(parent)->red = false;
+    getNode(grandparent)->red = true;
+    if (parentIsLeft) {
+      rotateRight(arena, grandparent);
+    } else {
+      rotateLeft(arena, grandparent);
+    }
+  }
+  getNode(arena->largeTree)->red = false;
+}
+
+/*
+* Removes a large free block from the tree, then rebalances from where a
+* black block went missing
+*/
+void treeRemove(Arena* arena, MetaBlock* block) {
+  TreeNode* node = getNode(block);
+  MetaBlock* child;
+  MetaBlock* parent;
+  bool removedRed = node->red;
+
+  if (node->left == NULL || node->right == NULL) {
+    // At most one child, which takes the block's place
+    child = node->left != NULL ? node->left : node->right;
+    parent = node->parent;
+    treeReplace(arena, block, child);
+  } else {
+    // Two children, the successor is moved into the block's place
+    MetaBlock* successor = node->right;
+    while (getNode(successor)->left != NULL) {
+      successor = getNode(successor)->left;
+    }
+    TreeNode* successorNode = getNode(successor);
+    removedRed = successorNode->red;
+    child = successorNode->right;
+
+    if (successorNode->parent == block) {
+      parent = successor;
+    } else {
+      parent = successorNode->parent;
+      treeReplace(arena, successor, child);
+      successorNode->right = node->right;
+      getNode(successorNode->right)->parent = successor;
+    }
+    treeReplace(arena, block, successor);
+    successorNode->left = node->left;
+    getNode(successorNode->left)->parent = successor;
+    successorNode->red = node->red;
+  }
+
+  if (removedRed) {
+    return;
+  }
+
+  // "child" is short one black on its path, fix it up towards the root
+  while (child != arena->largeTree && !isRed(child)) {
+    TreeNode* parentNode = getNode(parent);
+    bool childIsLeft = parentNode->left == child;
+    MetaBlock* sibling = childIsLeft ? parentNode->right : parentNode->left;
+
+    if (isRed(sibling)) {
+      getNode(sibling)->red = false;
+      parentNode->red = true;
+      if (childIsLeft) {
+        rotateLeft(arena, parent);
+        sibling = parentNode->right;
+      } else {
+        rotateRight(arena, parent);
+        sibling = parentNode->left;
+      }
+    }
+
+    TreeNode* siblingNode = getNode(sibling);
+    if (!isRed(siblingNode->left) && !isRed(siblingNode->right)) {
+      siblingNode->red = true;
+      child = parent;
+      parent = parentNode->parent;
+      continue;
+    }
+
+    if (childIsLeft) {
+      if (!isRed(siblingNode->right)) {
+        getNode(siblingNode->left)->red = false;
+        siblingNode->red = true;
+        rotateRight(arena, sibling);
+        sibling = parentNode->right;
+        siblingNode = getNode(sibling);
+      }
+      siblingNode->red = parentNode->red;
+      parentNode->red = false;
+      getNode(siblingNode->right)->red = false;
+      rotateLeft(arena, parent);
+    } else {
+      if (!isRed(siblingNode->left)) {
+        getNode(siblingNode->right)->red = false;
+        siblingNode->red = true;
+        rotateLeft(arena, sibling);
+        sibling = parentNode->left;
+        siblingNode = getNode(sibling);
+      }
+      siblingNode->red = parentNode->red;
+      parentNode->red = false;
+      getNode(siblingNode->left)->red = false;
+      rotateRight(arena, parent);
+    }
+    child = arena->largeTree;
+  }
+  if (child != NULL) {
+    getNode(child)->red = false;
+  }
+}
+
+/*
+* Best fit: the smallest large free block of at least "size" bytes, lowest
+* address first among equals
+*/
+MetaBlock* treeFind(Arena* arena, size_t size) {
+  MetaBlock* best = NULL;
+  MetaBlock* curr = arena->largeTree;
+  size_t steps = 0;
+  while (curr != NULL) {
+    steps++;
+    if (curr->size >= size) {
+      best = curr;
+      curr = getNode(curr)->left;
+    } else {
+      curr = getNode(curr)->right;
+    }
+  }
+  addStat(&arena->stats.searchSteps, steps);
+  return best;
+}
+
+/*
+* Returns the monotonic time in nanoseconds, from the cheap coarse clock
+*/
+uint64_t nowNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/*
+* Returns the monotonic time in nanoseconds, from the precise clock
+*/
+uint64_t traceClock() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/*
+* Finds the whole pages of a large free block between its tree node and its
+* footer, which can be purged, in purgeGrain runs. Returns false if there
+* are none
+*/
+bool purgeRange(MetaBlock* block, size_t* start, size_t* end) {
+  *start = round_up(((size_t) getNode(block)) + sizeof(TreeNode), purgeGrain);
+  *end = (((size_t) block) + block->size - sizeof(MetaBlock)) & ~(purgeGrain - 1);
+  return *end > *start;
+}
+
+/*
+* Appends a large free block with purgeable pages to the dirty list
+*/
+void markDirty(Arena* arena, MetaBlock* block) {
+  size_t start, end;
+  if (!purgeRange(block, &start, &end)) {
+    return;
+  }
+
+  TreeNode* node = getNode(block);
+  node->dirty = true;
+  node->freedAt = nowNs();
+  node->dirtyPrev = arena->dirtyTail;
+  node->dirtyNext = NULL;
+  if (arena->dirtyTail != NULL) {
+    getNode(arena->dirtyTail)->dirtyNext = block;
+  } else {
+    arena->dirtyHead = block;
+  }
+  arena->dirtyTail = block;
+}
+
+/*
+* Takes a block off the dirty list
+*/
+void unlinkDirty(Arena* arena, MetaBlock* block) {
+  TreeNode* node = getNode(block);
+  if (node->dirtyPrev != NULL) {
+    getNode(node->dirtyPrev)->dirtyNext = node->dirtyNext;
+  } else {
+    arena->dirtyHead = node->dirtyNext;
+  }
+  if (node->dirtyNext != NULL) {
+    getNode(node->dirtyNext)->dirtyPrev = node->dirtyPrev;
+  } else {
+    arena->dirtyTail = node->dirtyPrev;
+  }
+  node->dirty = false;
+}
+
+/*
+* Gives the pages of dirty blocks free for at least kPurgeDelay back to the
+* OS, or of every dirty block if "force" is set. Their tags and tree nodes
+* stay, the pages read back as zero. Returns whether anything was purged.
+* Caller must hold the arena's lock
+*/
+bool purgeDirty(Arena* arena, bool force) {
+  if (arena->dirtyHead == NULL) {
+    return false;
+  }
+
+  uint64_t now = force ? 0 : nowNs();
+  bool purged = false;
+  while (arena->dirtyHead != NULL &&
+         (force || now - getNode(arena->dirtyHead)->freedAt >= kPurgeDelay)) {
+    MetaBlock* block = arena->dirtyHead;
+    size_t start, end;
+    purgeRange(block, &start, &end);
+    madvise((void*) start, end - start, MADV_DONTNEED);
+    addStat(&arena->stats.purged, end - start);
+    unlinkDirty(arena, block);
+    purged = true;
+  }
+  return purged;
+}
+
+/*
+* Pushes a free block onto the front of its size's free list, or into the
+* tree if it is large. Fragments are left off both
+*/
+void insertBlock(Arena* arena, MetaBlock* block) {
+  // Fragments too small for links stay off the lists, only a neighbour
+  // coalescing with them takes them back
+  if (block->size < kPointerBlockSize) {
+    return;
+  }
+  if (block->size >= kLargeBlockSize) {
+    treeInsert(arena, block);
+    markDirty(arena, block);
+    return;
+  }
+
+  int idx = getIndex(block->size);
+  MetaBlock* head = arena->freeListArray[idx];
+
+  PointerBlock* blockPointers = getPointers(block);
+  blockPointers->prev = NULL;
+  blockPointers->next = head;
+  if (head != NULL) {
+    getPointers(head)->prev = block;
+  }
+  arena->freeListArray[idx] = block;
+
+  // Mark the list, and its first level, non-empty
+  arena->flBitmap |= 1u << (idx / SL_COUNT);
+  arena->slBitmap[idx / SL_COUNT] |= 1u << (idx % SL_COUNT);
+}
+
+/*
+* Unlinks a free block from its size's free list, or from the tree
+*/
+void removeBlock(Arena* arena, MetaBlock* block) {
+  if (block->size < kPointerBlockSize) {
+    return;
+  }
+  if (block->size >= kLargeBlockSize) {
+    treeRemove(arena, block);
+    if (getNode(block)->dirty) {
+      unlinkDirty(arena, block);
+    }
+    return;
+  }
+
+  int idx = getIndex(block->size);
+  PointerBlock* blockPointers = getPointers(block);
+  MetaBlock* prev = blockPointers->prev;
+  MetaBlock* next = blockPointers->next;
+
+  if (prev != NULL) {
+    getPointers(prev)->next = next;
+  } else {
+    arena->freeListArray[idx] = next;
+  }
+  if (next != NULL) {
+    getPointers(next)->prev = prev;
+  }
+
+  // Clear the bits of a list, and first level, that became empty
+  if (arena->freeListArray[idx] == NULL) {
+    arena->slBitmap[idx / SL_COUNT] &= ~(1u << (idx % SL_COUNT));
+    if (arena->slBitmap[idx / SL_COUNT] == 0) {
+      arena->flBitmap &= ~(1u << (idx / SL_COUNT));
+    }
+  }
+}
+
+/*
+* Finds the first non-empty free list whose blocks all fit "size", with
+* find-first-set over the two bitmap levels. Returns -1 if there is none
+*/
+int findList(Arena* arena, size_t size) {
+  int idx = getIndex(roundToList(size));
+  int fl = idx / SL_COUNT;
+  if (fl >= FL_COUNT) {
+    return -1;
+  }
+
+  // Any list from this step up within the same power of two
+  uint32_t slMap = arena->slBitmap[fl] & (~0u << (idx % SL_COUNT));
+  if (slMap == 0) {
+    // Otherwise the smallest list of the next non-empty power of two
+    uint32_t flMap = fl + 1 < 32 ? arena->flBitmap & (~0u << (fl + 1)) : 0;
+    if (flMap == 0) {
+      return -1;
+    }
+    fl = __builtin_ctz(flMap);
+    slMap = arena->slBitmap[fl];
+  }
+  return fl * SL_COUNT + __builtin_ctz(slMap);
+}
+
+/*
+* Moves the fresh mark of a block's chunk past the "size" bytes of it being
+* handed out. Returns whether they lay wholly past the mark, untouched
+*/
+bool markUsed(MetaBlock* block, size_t size) {
+  Chunk* chunk = getChunk(block);
+  bool fresh = ((size_t) block) >= chunk->fresh;
+  if (((size_t) block) + size > chunk->fresh) {
+    chunk->fresh = ((size_t) block) + size;
+  }
+  return fresh;
+}
+
+/*
+* Takes a free block of at least "size" bytes (tags included) off the free
+* lists, mapping a new chunk if none fits. Returns NULL, errno set, if that
+* fails. Caller must hold the arena's lock
+*/
+MetaBlock* takeBlock(Arena* arena, size_t size) {
+  MetaBlock* curr = NULL;
+  int idx = size < kLargeBlockSize ? findList(arena, size) : -1;
+  addStat(&arena->stats.searches, 1);
+
+  if (idx >= 0) {
+    addStat(&arena->stats.searchSteps, 1);
+    // Every block of the list fits, so its root is taken without a search
+    curr = arena->freeListArray[idx];
+  } else {
+    curr = treeFind(arena, size);
+  }
+
+  if (curr != NULL) {
+    // Splitting writes the tail's header, and its footer or the tag of the
+    // block on the right, far from this header, so fetch both while the
+    // block is unlinked
+    __builtin_prefetch(((char*) curr) + size, 1);
+    __builtin_prefetch(((char*) curr) + curr->size - sizeof(MetaBlock), 1);
+    removeBlock(arena, curr);
+  } else {
+    // Request additional memory from OS if we have no room
+    int multiple = (size + kChunkHeaderSize + 2*sizeof(MetaBlock)) / ARENA_SIZE + 1;
+    curr = initialise(arena, multiple);
+    if (curr == NULL) {
+      errno = ENOMEM;
+    }
+  }
+  return curr;
+}
+
+/*
+* Marks free block "curr", already off the free lists, allocated with
+* exactly "size" bytes, returning any tail to the free lists. If "zeroed"
+* is given, sets it when the payload is known to be zero bar the links
+* after its header and the footer at its end. Caller must hold the arena's
+* lock
+*/
+MetaBlock* carveBlock(Arena* arena, MetaBlock* curr, size_t size, bool* zeroed) {
+  // Split off the tail as a new free block, a fragment if it is too small
+  // for links, so the block's size is always the one asked for
+  if (curr->size > size) {
+    MetaBlock* secondBlock = splitBlock(arena, curr, size);
+    curr->size = size;
+    insertBlock(arena, secondBlock);
+  } else {
+    setPrevInUse((MetaBlock*) (((size_t) curr) + curr->size), true);
+  }
+  size = curr->size;
+
+  bool fresh = markUsed(curr, size);
+  if (zeroed != NULL) {
+    *zeroed = fresh;
+  }
+
+  // Only the header is tagged. A free block's left neighbour is in use
+  curr->size = size | kInUse | kPrevInUse;
+
+  return curr;
+}
+
+/*
+* Takes a block of at least "size" bytes (tags included) off the free lists
+* and marks it allocated, see carveBlock(). Returns NULL if no memory can be
+* mapped. Caller must hold the arena's lock
+*/
+MetaBlock* allocateBlock(Arena* arena, size_t size, bool* zeroed) {
+  MetaBlock* curr = takeBlock(arena, size);
+  if (curr == NULL) {
+    return NULL;
+  }
+  return carveBlock(arena, curr, size, zeroed);
+}
+
+/*
+* Allocates "n" blocks of "size" bytes (tags included) laid end to end, cut
+* from a single free block, storing their payloads in "out". The free lists
+* only change to take that block and to return its tail. Returns false,
+* allocating nothing, if no memory can be mapped. Caller must hold the
+* arena's lock
+*/
+bool allocateBlockRun(Arena* arena, size_t size, size_t n, void** out) {
+  MetaBlock* rest = takeBlock(arena, size * n);
+  if (rest == NULL) {
+    return false;
+  }
+  for (size_t i = 0; i + 1 < n; i++) {
+    MetaBlock* next = splitBlock(arena, rest, size);
+    rest->size = size | kInUse | kPrevInUse;
+    out[i] = (void*) (((size_t) rest) + sizeof(MetaBlock));
+    rest = next;
+  }
+
+  // The last block splits off the tail and moves the fresh mark past all
+  MetaBlock* last = carveBlock(arena, rest, size, NULL);
+  out[n - 1] = (void*) (((size_t) last) + sizeof(MetaBlock));
+  return true;
+}
+
+/*
+* Like allocateBlock(), but the payload is aligned to "alignment". The block
+* is carved out of a free one with room for any misalignment, and the
+* leading gap goes straight back to the free lists. Returns NULL if no
+* memory can be mapped. Caller must hold the arena's lock
+*/
+MetaBlock* allocateAlignedBlock(Arena* arena, size_t size, size_t alignment) {
+  // The gap is below "alignment", plus one more if it is too small to be a
+  // free block of its own
+  MetaBlock* curr = takeBlock(arena, size + alignment + kPointerBlockSize);
+  if (curr == NULL) {
+    return NULL;
+  }
+
+  size_t payload = ((size_t) curr) + sizeof(MetaBlock);
+  size_t gap = round_up(payload, alignment) - payload;
+  if (gap != 0 && gap < kPointerBlockSize) {
+    gap += round_up(kPointerBlockSize - gap, alignment);
+  }
+
+  // A free block's left neighbour is allocated, so the gap needs no coalesce
+  if (gap == 0) {
+    return carveBlock(arena, curr, size, NULL);
+  }
+  MetaBlock* aligned = splitBlock(arena, curr, gap);
+  curr->size = gap;
+  getRightMetaBlock(curr)->size = gap;
+  insertBlock(arena, curr);
+
+  // The aligned block has the gap as its free left neighbour
+  aligned = carveBlock(arena, aligned, size, NULL);
+  aligned->size &= ~kPrevInUse;
+  return aligned;
+}
+
+/*
+* Returns the object size of a slab class
+*/
+size_t slabClassSize(int sizeClass) {
+  return ((size_t) sizeClass + 1) << kSlabClassShift;
+}
+
+/*
+* Returns the slab class serving a "size" byte request. Requests as big as
+* kSlabAlignment are rounded up to it, so their objects are that aligned
+*/
+inline static int slabClass(size_t size) {
+  if (size >= kSlabAlignment) {
+    size = round_up(size, kSlabAlignment);
+  }
+  return (size - 1) >> kSlabClassShift;
+}
+
+/*
+* Returns the run a slab object lies in
+*/
+Run* getRun(void* ptr) {
+  return (Run*) (((size_t) ptr) & ~(kRunSize - 1));
+}
+
+/*
+* Returns the slot of "ptr" in its run of "sizeClass", or -1 if it doesn't
+* start an object
+*/
+long getSlot(Run* run, int sizeClass, void* ptr) {
+  size_t offset = ((size_t) ptr) - ((size_t) run) - kRunHeaderSize;
+  size_t objSize = slabClassSize(sizeClass);
+  if (offset % objSize != 0 || offset / objSize >= (kRunSize - kRunHeaderSize) / objSize) {
+    return -1;
+  }
+  return offset / objSize;
+}
+
+/*
+* Checks "ptr", whose page has "entry" in the page map, starts a live
+* object: for slab objects, that the bitmap marks it used, for blocks, that
+* a header in use sits before it
+*/
+bool isAllocated(PageEntry entry, void* ptr) {
+  Chunk* chunk = entryChunk(entry);
+  if (chunk == NULL) {
+    return false;
+  }
+
+  // Pages without a run, the chunk header's among them, have no class
+  if (entryKind(entry) == SLAB_CHUNK) {
+    int sizeClass = entrySlabClass(entry);
+    Run* run = getRun(ptr);
+    long slot = sizeClass < 0 ? -1 : getSlot(run, sizeClass, ptr);
+    return slot >= 0 && !(run->bitmap[slot >> 6] & (1ull << (slot & 63)));
+  }
+
+  // A huge chunk's one block sits right after its left fence post, and the
+  // chunk may end mid window, so nothing else is read
+  if (entryKind(entry) == HUGE_CHUNK) {
+    return ((size_t) ptr) == ((size_t) chunk) + kChunkHeaderSize + chunk->lead + 2*sizeof(MetaBlock);
+  }
+
+  // The word before an aligned pointer past the left fence post is only
+  // taken for a header if the block it describes ends inside the chunk
+  if (((size_t) ptr) % kAlignment != 0 ||
+      ((size_t) ptr) < ((size_t) chunk) + kChunkHeaderSize + 2*sizeof(MetaBlock)) {
+    return false;
+  }
+  MetaBlock* toRemove = (MetaBlock*) (((size_t) ptr) - sizeof(MetaBlock));
+  size_t size = tagSize(toRemove);
+  return (toRemove->size & kInUse) != 0 && size >= kPointerBlockSize && size % kBlockAlignment == 0 &&
+         getChunk((void*) (((size_t) toRemove) + size - 1)) == chunk;
+}
+
+/*
+* Coalese Function, takes in address of Central MetaBlock, then 
+* checks left & right neighbours for combination
+* Free neighbours leave their lists, the combined block joins the list of
+* its new size. "leftFree" comes from the kPrevInUse bit the block had in
+* use, the left neighbour's footer is only read if it is set
+*/
+void coalesce(Arena* arena, MetaBlock* curr, bool leftFree) {
+  // Obtaining start address of adjacent MetaBlocks
+  MetaBlock* leftNeighbour = (MetaBlock*) (((size_t) curr) - sizeof(MetaBlock));
+  MetaBlock* rightNeighbour = (MetaBlock*) (((size_t) curr) + curr->size);
+
+  // Storing new root and size, may be unchanged
+  MetaBlock* root = curr;
+  size_t newSize = curr->size;
+
+  // Checking if NOT fence post and unallocated
+  if (!(rightNeighbour->size & (kInUse | kFence))) {
+    newSize += rightNeighbour->size;
+    removeBlock(arena, rightNeighbour);
+    addStat(&arena->stats.coalesces, 1);
+  }
+
+  // Reassigning left root if left block is free
+  if (leftFree) {
+    newSize += leftNeighbour->size;
+    MetaBlock* leftNeighbourHeader = (MetaBlock*) (((size_t) leftNeighbour) - leftNeighbour->size + sizeof(MetaBlock));
+    removeBlock(arena, leftNeighbourHeader);
+    addStat(&arena->stats.coalesces, 1);
+
+    root = leftNeighbourHeader;
+  }
+
+  // A block spanning its whole chunk means the chunk is empty, unmap it
+  // unless it is the arena's last one
+  Chunk* chunk = getChunk(root);
+  if (arena->nBlockChunks > 1 &&
+      ((size_t) root) == ((size_t) chunk) + kChunkHeaderSize + sizeof(MetaBlock) &&
+      newSize == chunk->size - kChunkHeaderSize - 2*sizeof(MetaBlock)) {
+    arena->nBlockChunks--;
+    unmapChunk(chunk);
+    return;
+  }
+
+  // Update both boundary tags, tell the block on the right, then file the
+  // block under its new size
+  root->size = newSize;
+  MetaBlock* coalescedRight = getRightMetaBlock(root);
+  coalescedRight->size = newSize;
+  setPrevInUse(coalescedRight + 1, false);
+
+  insertBlock(arena, root);
+}
+
+/*
+* Returns an allocated block to its arena's free lists. Caller must hold the
+* arena's lock
+*/
+void freeBlock(Arena* arena, MetaBlock* toRemove) {
+  // Clear out the bits in use, coalesce() writes the footer
+  bool leftFree = !(toRemove->size & kPrevInUse);
+  toRemove->size = tagSize(toRemove);
+
+  // Coalesce, updating new root among 3 coninuous blocks
+  coalesce(arena, toRemove, leftFree);
+}
+
+/*
+* Resizes allocated block "curr" in place to "size" bytes (tags included),
+* growing into its right neighbour if that is free, and giving back any
+* tail. Returns false, changing nothing, if the block can't grow that far.
+* Caller must hold the arena's lock
+*/
+bool resizeBlock(Arena* arena, MetaBlock* curr, size_t size) {
+  size_t currSize = tagSize(curr);
+  size_t prevInUse = curr->size & kPrevInUse;
+
+  if (size > currSize) {
+    // Same boundary tag test coalesce() makes on the right neighbour
+    MetaBlock* rightNeighbour = (MetaBlock*) (((size_t) curr) + currSize);
+    if ((rightNeighbour->size & (kInUse | kFence)) ||
+        currSize + rightNeighbour->size < size) {
+      return false;
+    }
+    removeBlock(arena, rightNeighbour);
+    currSize += rightNeighbour->size;
+    markUsed(curr, currSize);
+  }
+
+  // Any tail is freed, otherwise the block on the right may have just lost
+  // its free neighbour
+  curr->size = currSize;
+  MetaBlock* tail = NULL;
+  if (currSize > size) {
+    tail = splitBlock(arena, curr, size);
+    curr->size = size;
+  } else {
+    setPrevInUse((MetaBlock*) (((size_t) curr) + currSize), true);
+  }
+  curr->size = curr->size | kInUse | prevInUse;
+
+  if (tail != NULL) {
+    coalesce(arena, tail, false);
+  }
+  return true;
+}
+
+/*
+* Unlinks a run from the doubly linked run list starting at "head"
+*/
+void unlinkRun(Run** head, Run* run) {
+  if (run->prev != NULL) {
+    run->prev->next = run->next;
+  } else {
+    *head = run->next;
+  }
+  if (run->next != NULL) {
+    run->next->prev = run->prev;
+  }
+}
+
+/*
+* Pushes a run onto the front of the run list starting at "head"
+*/
+void pushRun(Run** head, Run* run) {
+  run->prev = NULL;
+  run->next = *head;
+  if (*head != NULL) {
+    (*head)->prev = run;
+  }
+  *head = run;
+}
+
+/*
+* Returns the slab bookkeeping of "chunk"
+*/
+inline static SlabInfo* slabInfo(Chunk* chunk) {
+  return (SlabInfo*) (((size_t) chunk) + kChunkHeaderSize);
+}
+
+/*
+* Takes a purged run from the first slab chunk of "arena" that has one.
+* Caller must hold the arena's lock
+*/
+Run* takePurgedRun(Arena* arena) {
+  Chunk* chunk = arena->purgedChunks;
+  SlabInfo* info = slabInfo(chunk);
+  int word = 0;
+  while (info->purged[word] == 0) {
+    word++;
+  }
+  size_t idx = word * 64 + __builtin_ctzll(info->purged[word]);
+  info->purged[word] &= info->purged[word] - 1;
+  info->nEmpty--;
+  info->nPurged--;
+  if (info->nPurged == 0) {
+    arena->purgedChunks = info->nextPurged;
+  }
+  return (Run*) (((size_t) chunk) + idx * kRunSize);
+}
+
+/*
+* Sets up a run of "sizeClass" with every object free, reusing an empty run,
+* then a purged one, or carving the next one from the arena's slab chunk.
+* Caller must hold the arena's lock
+*/
+Run* newRun(Arena* arena, int sizeClass) {
+  Run* run = arena->emptyRuns;
+  if (run != NULL) {
+    unlinkRun(&arena->emptyRuns, run);
+    slabInfo(getChunk(run))->nEmpty--;
+  } else if (arena->purgedChunks != NULL) {
+    run = takePurgedRun(arena);
+  } else {
+    // Map a new slab chunk once the current one is carved up
+    if (arena->slabChunk == NULL || arena->nextRun == ARENA_SIZE / kRunSize) {
+      arena->slabChunk = newChunk(arena, ARENA_SIZE, SLAB_CHUNK);
+      if (arena->slabChunk == NULL) {
+        return NULL;
+      }
+      // First page is the chunk header
+      arena->nextRun = 1;
+    }
+    run = (Run*) (((size_t) arena->slabChunk) + arena->nextRun * kRunSize);
+    arena->nextRun++;
+  }
+
+  run->sizeClass = sizeClass;
+  run->nObjects = (kRunSize - kRunHeaderSize) / slabClassSize(sizeClass);
+  setRunClass(run, sizeClass);
+  run->nFree = run->nObjects;
+
+  // One set bit per object, whole words first
+  memset(run->bitmap, 0, sizeof(run->bitmap));
+  for (int i = 0; i < run->nObjects / 64; i++) {
+    run->bitmap[i] = ~0ull;
+  }
+  if (run->nObjects % 64 != 0) {
+    run->bitmap[run->nObjects / 64] = (1ull << (run->nObjects % 64)) - 1;
+  }
+
+  pushRun(&arena->partialRuns[sizeClass], run);
+  return run;
+}
+
+/*
+* Takes a free object of "sizeClass" from the first partial run. Caller must
+* hold the arena's lock
+*/
+void* slabAlloc(Arena* arena, int sizeClass) {
+  Run* run = arena->partialRuns[sizeClass];
+  if (run == NULL) {
+    run = newRun(arena, sizeClass);
+    if (run == NULL) {
+      return NULL;
+    }
+  }
+
+  // Find first set bit, then clear it to mark the object used
+  int word = 0;
+  while (run->bitmap[word] == 0) {
+    word++;
+  }
+  int slot = word * 64 + __builtin_ctzll(run->bitmap[word]);
+  run->bitmap[word] &= run->bitmap[word] - 1;
+
+  // Full runs leave the partial list until an object is freed
+  run->nFree--;
+  if (run->nFree == 0) {
+    unlinkRun(&arena->partialRuns[sizeClass], run);
+  }
+
+  return (void*) (((size_t) run) + kRunHeaderSize + slot * slabClassSize(sizeClass));
+}
+
+/*
+* Gives a slab chunk whose runs are all empty back to the page heap, after
+* taking its runs off the arena's empty list and the chunk off its purged
+* list. Caller must hold the arena's lock
+*/
+void releaseSlabChunk(Arena* arena, Chunk* chunk) {
+  SlabInfo* info = slabInfo(chunk);
+  for (size_t i = 1; i < SLAB_CHUNK_RUNS; i++) {
+    if (!(info->purged[i / 64] & (1ull << (i % 64)))) {
+      unlinkRun(&arena->emptyRuns, (Run*) (((size_t) chunk) + i * kRunSize));
+    }
+  }
+  if (info->nPurged > 0) {
+    Chunk** prev = &arena->purgedChunks;
+    while (*prev != chunk) {
+      prev = &slabInfo(*prev)->nextPurged;
+    }
+    *prev = info->nextPurged;
+  }
+  unmapChunk(chunk);
+}
+
+/*
+* Marks a slab object free in its run's bitmap, moving the run between lists
+* as it stops being full or becomes empty. A chunk whose runs are then all
+* empty goes back to the page heap, unless the arena still carves it.
+* Caller must hold the arena's lock
+*/
+void slabFree(Arena* arena, void* ptr) {
+  Run* run = getRun(ptr);
+  long slot = getSlot(run, run->sizeClass, ptr);
+  run->bitmap[slot >> 6] |= 1ull << (slot & 63);
+  run->nFree++;
+
+  if (run->nFree == 1) {
+    pushRun(&arena->partialRuns[run->sizeClass], run);
+  }
+  if (run->nFree == run->nObjects) {
+    unlinkRun(&arena->partialRuns[run->sizeClass], run);
+    pushRun(&arena->emptyRuns, run);
+    Chunk* chunk = getChunk(run);
+    SlabInfo* info = slabInfo(chunk);
+    info->nEmpty++;
+    if (info->nEmpty == SLAB_CHUNK_RUNS - 1 && chunk != arena->slabChunk) {
+      releaseSlabChunk(arena, chunk);
+    }
+  }
+}
+
+/*
+* Purges the pages of every empty slab run of "arena", moving the runs off
+* the empty list into their chunk's purged set, where their pages no longer
+* map to a slab class. Returns whether any were purged. Caller must hold the
+* arena's lock
+*/
+bool purgeEmptyRuns(Arena* arena) {
+  // A run is a single page, purging it would split a huge page
+  if (purgeGrain > kRunSize) {
+    return false;
+  }
+
+  bool purged = false;
+  while (arena->emptyRuns != NULL) {
+    Run* run = arena->emptyRuns;
+    unlinkRun(&arena->emptyRuns, run);
+    setRunClass(run, -1);
+    madvise(run, kRunSize, MADV_DONTNEED);
+    addStat(&arena->stats.purged, kRunSize);
+
+    Chunk* chunk = getChunk(run);
+    SlabInfo* info = slabInfo(chunk);
+    size_t idx = (((size_t) run) - ((size_t) chunk)) / kRunSize;
+    info->purged[idx / 64] |= 1ull << (idx % 64);
+    if (info->nPurged == 0) {
+      info->nextPurged = arena->purgedChunks;
+      arena->purgedChunks = chunk;
+    }
+    info->nPurged++;
+    purged = true;
+  }
+  return purged;
+}
+
+/*
+* Returns whether an allocation on a page with "entry" has room for a
+* cookie after its link: blocks and all but 8 byte slab objects
+*/
+inline static bool hasCookie(PageEntry entry) {
+  return entryKind(entry) == BLOCK_CHUNK || (entryKind(entry) == SLAB_CHUNK && entrySlabClass(entry) > 0);
+}
+
+/*
+* Frees a block or slab object back into "arena". Caller must hold the
+* arena's lock
+*/
+void releaseLocked(Arena* arena, void* ptr) {
+  if (entryKind(getEntry(ptr)) == SLAB_CHUNK) {
+    slabFree(arena, ptr);
+  } else {
+    freeBlock(arena, (MetaBlock*) (((size_t) ptr) - sizeof(MetaBlock)));
+  }
+}
+
+/*
+* Lock-free push of a block onto its owner's remote free list, so a thread
+* of another arena never takes the owner's lock. A "marked" block gets the
+* remote cookie after its link
+*/
+void pushRemoteFree(Arena* owner, void* ptr, bool marked) {
+  void** link = ptr;
+  if (marked) {
+    link[1] = (void*) remoteCookie;
+  }
+  void* head = atomic_load_explicit(&owner->remoteFrees, memory_order_relaxed);
+  do {
+    *link = head;
+  } while (!atomic_compare_exchange_weak_explicit(&owner->remoteFrees, &head, link,
+                                                  memory_order_release, memory_order_relaxed));
+}
+
+/*
+* Takes the whole remote free list at once and coalesces every block on it
+* back into the free lists. Caller must hold the arena's lock
+*/
+void collectRemoteFrees(Arena* arena) {
+  if (atomic_load_explicit(&arena->remoteFrees, memory_order_relaxed) == NULL) {
+    return;
+  }
+
+  void** link = atomic_exchange_explicit(&arena->remoteFrees, NULL, memory_order_acquire);
+  while (link != NULL) {
+    // The next block's header, and so its links, load while this one is freed
+    void** next = *link;
+    __builtin_prefetch(((char*) next) - sizeof(MetaBlock), 1);
+    if (hasCookie(getEntry(link))) {
+      link[1] = NULL;
+    }
+    releaseLocked(arena, link);
+    link = next;
+  }
+}
+
+/*
+* Moves a batch of blocks of "size" bytes from the free lists into a cache
+* bin, so the next few allocations of this size don't need the lock. Stops
+* early if no more memory can be mapped
+*/
+void refillCacheBin(Arena* arena, CacheBin* bin, size_t size) {
+  pthread_mutex_lock(&arena->lock);
+  collectRemoteFrees(arena);
+  for (int i = 0; i < kCacheBatch; i++) {
+    MetaBlock* block = allocateBlock(arena, size, NULL);
+    if (block == NULL) {
+      break;
+    }
+    void** link = (void**) (((size_t) block) + sizeof(MetaBlock));
+    *link = bin->head;
+    bin->head = link;
+    bin->count++;
+  }
+  pthread_mutex_unlock(&arena->lock);
+}
+
+/*
+* Moves a batch of objects of "sizeClass" from the arena's runs into a slab
+* cache bin. Stops early if no more memory can be mapped
+*/
+void refillSlabBin(Arena* arena, CacheBin* bin, int sizeClass) {
+  pthread_mutex_lock(&arena->lock);
+  collectRemoteFrees(arena);
+  for (int i = 0; i < kCacheBatch; i++) {
+    void** link = slabAlloc(arena, sizeClass);
+    if (link == NULL) {
+      break;
+    }
+    *link = bin->head;
+    bin->head = link;
+    bin->count++;
+  }
+  pthread_mutex_unlock(&arena->lock);
+}
+
+/*
+* Returns up to "n" blocks from the top of a cache bin to the free lists.
+* Caller must hold the arena's lock
+*/
+void flushLocked(Arena* arena, CacheBin* bin, int n) {
+  while (n > 0 && bin->head != NULL) {
+    void** link = bin->head;
+    bin->head = *link;
+    bin->count--;
+    n--;
+    __builtin_prefetch(((char*) bin->head) - sizeof(MetaBlock), 1);
+    releaseLocked(arena, link);
+  }
+}
+
+/*
+* Returns up to "n" blocks from the top of a cache bin to the free lists
+*/
+void flushCacheBin(Arena* arena, CacheBin* bin, int n) {
+  pthread_mutex_lock(&arena->lock);
+  collectRemoteFrees(arena);
+  flushLocked(arena, bin, n);
+  purgeDirty(arena, false);
+  pthread_mutex_unlock(&arena->lock);
+}
+
+/*
+* Returns every block a thread cache holds to the free lists, under a
+* single hold of the arena's lock
+*/
+void drainCacheBins(ThreadCache* tc) {
+  Arena* arena = tc->arena;
+  pthread_mutex_lock(&arena->lock);
+  collectRemoteFrees(arena);
+  for (int i = 0; i < N_SLAB_CLASSES; i++) {
+    flushLocked(arena, &tc->slabBins[i], tc->slabBins[i].count);
+  }
+  for (int i = 0; i < N_CACHE_BINS; i++) {
+    flushLocked(arena, &tc->bins[i], tc->bins[i].count);
+  }
+  purgeDirty(arena, false);
+  pthread_mutex_unlock(&arena->lock);
+}
+
+/*
+* Takes a stats slot for a new thread, a free one if there is any
+*/
+ThreadStats* takeStats() {
+  pthread_mutex_lock(&statsLock);
+  ThreadStats* stats = freeStats;
+  if (stats != NULL) {
+    freeStats = stats->nextFree;
+  }
+  pthread_mutex_unlock(&statsLock);
+  if (stats != NULL) {
+    return stats;
+  }
+
+  stats = mapPages(round_up(sizeof(ThreadStats), kPageSize));
+  if (stats == MAP_FAILED) {
+    return &spareStats;
+  }
+  stats->next = atomic_load_explicit(&allStats, memory_order_relaxed);
+  while (!atomic_compare_exchange_weak_explicit(&allStats, &stats->next, stats,
+                                                memory_order_release, memory_order_relaxed)) {
+  }
+  return stats;
+}
+
+/*
+* Hands the slot of a finished thread on, its counts stay in the totals
+*/
+void releaseStats(ThreadStats* stats) {
+  if (stats == &spareStats) {
+    return;
+  }
+  pthread_mutex_lock(&statsLock);
+  stats->nextFree = freeStats;
+  freeStats = stats;
+  pthread_mutex_unlock(&statsLock);
+}
+
+/*
+* Takes a trace buffer for a new thread, a free one if there is any. NULL if
+* none can be mapped, the thread's calls then go unrecorded
+*/
+TraceBuffer* takeTrace() {
+  pthread_mutex_lock(&traceLock);
+  TraceBuffer* buffer = freeTraces;
+  if (buffer != NULL) {
+    freeTraces = buffer->nextFree;
+  } else {
+    buffer = mapPages(round_up(sizeof(TraceBuffer), kPageSize));
+    if (buffer == MAP_FAILED) {
+      buffer = NULL;
+    } else {
+      buffer->next = allTraces;
+      allTraces = buffer;
+    }
+  }
+  pthread_mutex_unlock(&traceLock);
+  return buffer;
+}
+
+/*
+* Appends the records of "buffer" to the trace file and empties it. Caller
+* must hold traceLock
+*/
+void writeTrace(TraceBuffer* buffer) {
+  size_t count = atomic_load_explicit(&buffer->count, memory_order_acquire);
+  int fd = atomic_load_explicit(&traceFd, memory_order_relaxed);
+  if (fd >= 0) {
+    writeAll(fd, buffer->records, count * sizeof(my_trace_record));
+  }
+  atomic_store_explicit(&buffer->count, 0, memory_order_relaxed);
+}
+
+/*
+* Writes out the buffer of a finished thread and hands it on
+*/
+void releaseTrace(TraceBuffer* buffer) {
+  pthread_mutex_lock(&traceLock);
+  writeTrace(buffer);
+  buffer->nextFree = freeTraces;
+  freeTraces = buffer;
+  pthread_mutex_unlock(&traceLock);
+}
+
+/*
+* Opens the trace file MYMALLOC_TRACE names, if any, and writes its header
+*/
+static void openTrace(void) {
+  const char* env = getenv("MYMALLOC_TRACE");
+  if (env == NULL) {
+    return;
+  }
+
+  // Children running the same program get files of their own
+  char path[4096];
+  size_t len = 0;
+  for (const char* c = env; *c != '\0' && len < sizeof(path) - 24; c++) {
+    if (c[0] == '%' && c[1] == 'p') {
+      len += snprintf(path + len, sizeof(path) - len, "%d", (int) getpid());
+      c++;
+    } else {
+      path[len++] = *c;
+    }
+  }
+  path[len] = '\0';
+
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    return;
+  }
+  my_trace_header header = {MY_TRACE_MAGIC, MY_TRACE_VERSION, sizeof(my_trace_record)};
+  writeAll(fd, &header, sizeof(header));
+  traceStart = traceClock();
+  atomic_store_explicit(&traceFd, fd, memory_order_relaxed);
+}
+
+/*
+* Writes every thread's pending records as the process exits, and ends the
+* trace. Threads still running record nothing more
+*/
+__attribute__((destructor))
+static void closeTrace(void) {
+  pthread_mutex_lock(&traceLock);
+  int fd = atomic_load_explicit(&traceFd, memory_order_relaxed);
+  if (fd >= 0) {
+    for (TraceBuffer* buffer = allTraces; buffer != NULL; buffer = buffer->next) {
+      writeTrace(buffer);
+    }
+    atomic_store_explicit(&traceFd, -1, memory_order_relaxed);
+    close(fd);
+  }
+  pthread_mutex_unlock(&traceLock);
+}
+
+/*
+* Key destructor, hands every block a finished thread still caches back
+*/
+static void drainThreadCache(void* cache) {
+  ThreadCache* tc = cache;
+  drainCacheBins(tc);
+  releaseStats(tc->stats);
+  tc->stats = NULL;
+  if (tc->trace != NULL) {
+    releaseTrace(tc->trace);
+    tc->trace = NULL;
+  }
+  // Caching again from a later destructor registers the cache again
+  tc->registered = false;
+}
+
+static void createCacheKey(void) {
+  pthread_key_create(&cacheKey, drainThreadCache);
+}
+
+/*
+* Sizes the arena array, MYMALLOC_ARENAS overrides the online core count,
+* reads the huge block threshold, the huge page mode and the profiler's
+* sampling interval, picks the cache and remote cookies and starts tracing
+*/
+static void createArenas(void) {
+  nCpus = sysconf(_SC_NPROCESSORS_ONLN);
+  const char* env = getenv("MYMALLOC_ARENAS");
+  long n = env != NULL ? strtol(env, NULL, 10) : nCpus;
+  if (n < 1) {
+    n = 1;
+  }
+  if (n > MAX_ARENAS) {
+    n = MAX_ARENAS;
+  }
+
+  for (int i = 0; i < n; i++) {
+    pthread_mutex_init(&arenas[i].lock, NULL);
+  }
+  nArenas = n;
+
+  // Smaller huge blocks would take the sizes thread caches and free lists
+  // are there for
+  env = getenv("MYMALLOC_MMAP_THRESHOLD");
+  if (env != NULL) {
+    size_t threshold = strtoull(env, NULL, 10);
+    hugeThreshold = threshold < kLargeBlockSize ? kLargeBlockSize : threshold;
+  }
+  env = getenv("MYMALLOC_THP");
+  if (env != NULL && (strcmp(env, "1") == 0 || strcmp(env, "madvise") == 0)) {
+    hugePages = HUGE_PAGES_MADVISE;
+  } else if (env != NULL && strcmp(env, "hugetlb") == 0) {
+    hugePages = HUGE_PAGES_HUGETLB;
+  }
+  if (hugePages != HUGE_PAGES_OFF) {
+    purgeGrain = kHugePageSize;
+  }
+  env = getenv("MYMALLOC_PROF_SAMPLE");
+  if (env != NULL) {
+    profInterval = strtoull(env, NULL, 10);
+  }
+  cacheCookie = (traceClock() ^ (size_t) &cacheCookie) | 1;
+  remoteCookie = cacheCookie ^ (((size_t) &remoteCookie) << 1);
+  openTrace();
+}
+
+/*
+* Picks the arena for a new thread, the one of the CPU it is running on, or
+* the next in round-robin order if that is unknown or arenas outnumber CPUs
+*/
+Arena* chooseArena() {
+  pthread_once(&arenasOnce, createArenas);
+
+  int cpu = sched_getcpu();
+  if (cpu < 0 || nArenas > nCpus) {
+    cpu = atomic_fetch_add_explicit(&nextArena, 1, memory_order_relaxed);
+  }
+  return &arenas[cpu % nArenas];
+}
+
+/*
+* Fork handlers: every lock is held across fork(), so the child never sees
+* an arena mid-update, then released in the parent and reset in the child
+*/
+static void lockAll(void) {
+  for (int i = 0; i < nArenas; i++) {
+    pthread_mutex_lock(&arenas[i].lock);
+  }
+  pthread_mutex_lock(&pageHeapLock);
+  pthread_mutex_lock(&pageMapLock);
+  pthread_mutex_lock(&statsLock);
+  pthread_mutex_lock(&traceLock);
+  pthread_mutex_lock(&profLock);
+}
+
+static void unlockAll(void) {
+  pthread_mutex_unlock(&profLock);
+  pthread_mutex_unlock(&traceLock);
+  pthread_mutex_unlock(&statsLock);
+  pthread_mutex_unlock(&pageMapLock);
+  pthread_mutex_unlock(&pageHeapLock);
+  for (int i = nArenas - 1; i >= 0; i--) {
+    pthread_mutex_unlock(&arenas[i].lock);
+  }
+}
+
+static void resetLocks(void) {
+  // The child's buffers hold records of the parent, so it traces nothing
+  atomic_store_explicit(&traceFd, -1, memory_order_relaxed);
+  pthread_mutex_init(&profLock, NULL);
+  pthread_mutex_init(&traceLock, NULL);
+  pthread_mutex_init(&statsLock, NULL);
+  pthread_mutex_init(&pageMapLock, NULL);
+  pthread_mutex_init(&pageHeapLock, NULL);
+  for (int i = 0; i < nArenas; i++) {
+    pthread_mutex_init(&arenas[i].lock, NULL);
+  }
+}
+
+/*
+* Natural logarithm of "x" > 0 to within 1e-4, without libm: the exponent
+* plus a polynomial fit of the mantissa
+*/
+double fastLog(double x) {
+  union {
+    double d;
+    uint64_t bits;
+  } v = {x};
+  int exponent = (int) ((v.bits >> 52) & 0x7ff) - 1023;
+  v.bits = (v.bits & ((1ull << 52) - 1)) | (1023ull << 52);
+  double m = v.d;
+  return exponent * 0.6931471805599453 +
+         (-1.7417939 + (2.8212026 + (-1.4699568 + (0.44717955 - 0.056570851 * m) * m) * m) * m);
+}
+
+/*
+* Returns the bytes the thread allocates before its next sample. They are
+* exponentially distributed with mean profInterval, so every byte is as
+* likely to be sampled whatever the sizes around it
+*/
+ptrdiff_t nextSample(ThreadCache* tc) {
+  if (profInterval == 0) {
+    return PTRDIFF_MAX;
+  }
+  uint64_t x = tc->sampleSeed;
+  if (x == 0) {
+    x = (((size_t) tc) ^ traceClock()) | 1;
+  }
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  tc->sampleSeed = x;
+  // Uniform in (0, 1]
+  double u = ((x >> 11) + 1) * 0x1p-53;
+  return (ptrdiff_t) (-fastLog(u) * profInterval);
+}
+
+/*
+* Returns the calling thread's cache, binding it to an arena and registering
+* it to be drained on exit, and the fork handlers once per process
+*/
+ThreadCache* getThreadCache() {
+  ThreadCache* tc = &threadCache;
+  if (!tc->registered) {
+    if (tc->arena == NULL) {
+      tc->arena = chooseArena();
+    }
+    if (tc->stats == NULL) {
+      tc->stats = takeStats();
+    }
+    tc->sampleLeft = nextSample(tc);
+    pthread_once(&cacheKeyOnce, createCacheKey);
+    // Marked first, pthread_setspecific may allocate and land back here
+    tc->registered = true;
+    pthread_setspecific(cacheKey, tc);
+  }
+  if (!atomic_load_explicit(&forkHandlersSet, memory_order_relaxed) &&
+      !atomic_exchange(&forkHandlersSet, true)) {
+    pthread_atfork(lockAll, unlockAll, resetLocks);
+  }
+  return tc;
+}
+
+/*
+* Returns whether MYMALLOC_TRACE is recording calls
+*/
+inline static bool tracing() {
+  return __builtin_expect(atomic_load_explicit(&traceFd, memory_order_relaxed) >= 0, 0);
+}
+
+/*
+* Records a call of "op" on "ptr" in the calling thread's trace buffer,
+* writing the buffer out once it is full
+*/
+void traceCall(int op, void* ptr, size_t size, size_t alignment) {
+  ThreadCache* tc = getThreadCache();
+  if (tc->trace == NULL) {
+    tc->trace = takeTrace();
+    if (tc->trace == NULL) {
+      return;
+    }
+    tc->traceThread = atomic_fetch_add_explicit(&traceThreads, 1, memory_order_relaxed);
+  }
+
+  TraceBuffer* buffer = tc->trace;
+  size_t count = atomic_load_explicit(&buffer->count, memory_order_relaxed);
+  buffer->records[count] = (my_trace_record) {
+    .seq = atomic_fetch_add_explicit(&traceSeq, 1, memory_order_relaxed),
+    .time = traceClock() - traceStart,
+    .ptr = (size_t) ptr,
+    .size = size,
+    .thread = tc->traceThread,
+    .op = op,
+    .align = alignment > 0 ? __builtin_ctzll(alignment) : 0,
+  };
+  atomic_store_explicit(&buffer->count, count + 1, memory_order_release);
+  if (count + 1 == TRACE_RECORDS) {
+    pthread_mutex_lock(&traceLock);
+    writeTrace(buffer);
+    pthread_mutex_unlock(&traceLock);
+  }
+}
+
+/*
+* Returns the first slot of the set "ptr" is sampled in
+*/
+inline static size_t sampleSet(void* ptr) {
+  uint64_t hash = (((size_t) ptr) >> 4) * 0x9e3779b97f4a7c15ull;
+  return (hash >> 32) % (PROF_SLOTS / PROF_WAYS) * PROF_WAYS;
+}
+
+/*
+* Returns the profile's entry for the stack "frames", adding it if it is new.
+* Caller must hold profLock
+*/
+ProfStack* findStack(void** frames, int depth) {
+  uint64_t hash = depth;
+  for (int i = 0; i < depth; i++) {
+    hash = (hash ^ (size_t) frames[i]) * 0x100000001b3ull;
+  }
+  ProfStack** bucket = &profBuckets[hash % PROF_STACK_BUCKETS];
+  for (ProfStack* stack = *bucket; stack != NULL; stack = stack->next) {
+    if (stack->depth == depth && memcmp(stack->frames, frames, depth * sizeof(void*)) == 0) {
+      return stack;
+    }
+  }
+
+  if (nProfStacks == PROF_STACKS) {
+    return &profStacks[PROF_STACKS - 1];
+  }
+  ProfStack* stack = &profStacks[nProfStacks++];
+  memcpy(stack->frames, frames, depth * sizeof(void*));
+  stack->depth = depth;
+  stack->next = *bucket;
+  *bucket = stack;
+  return stack;
+}
+
+/*
+* Samples the allocation of "size" bytes at "ptr": counts it at the stack it
+* was made from, and keeps it as a live sample until it is freed. A block
+* whose set of slots is full is only counted as allocated
+*/
+void takeSample(void* ptr, size_t size) {
+  ThreadCache* tc = &threadCache;
+  tc->sampleLeft = nextSample(tc);
+  // backtrace() allocates the first time round
+  if (tc->sampling) {
+    return;
+  }
+  tc->sampling = true;
+  void* frames[PROF_FRAMES + 1];
+  int depth = backtrace(frames, PROF_FRAMES + 1);
+
+  pthread_mutex_lock(&profLock);
+  // Leaving out this function's own frame
+  ProfStack* stack = findStack(frames + 1, depth - 1);
+  stack->allocCount++;
+  stack->allocBytes += size;
+  size_t set = sampleSet(ptr);
+  for (size_t i = set; i < set + PROF_WAYS; i++) {
+    if (atomic_load_explicit(&sampleKeys[i], memory_order_relaxed) == NULL) {
+      sampleStacks[i] = stack;
+      sampleSizes[i] = size;
+      stack->liveCount++;
+      stack->liveBytes += size;
+      atomic_store_explicit(&sampleKeys[i], ptr, memory_order_relaxed);
+      atomic_fetch_add_explicit(&nSamples, 1, memory_order_relaxed);
+      break;
+    }
+  }
+  pthread_mutex_unlock(&profLock);
+  tc->sampling = false;
+}
+
+/*
+* Counts "size" bytes allocated at "ptr" towards the thread's next sample
+*/
+inline static void countSample(void* ptr, size_t size) {
+  ThreadCache* tc = &threadCache;
+  tc->sampleLeft -= size;
+  if (__builtin_expect(tc->sampleLeft < 0, 0)) {
+    takeSample(ptr, size);
+  }
+}
+
+/*
+* Drops "ptr" from the live samples, if it is one, as it is freed. Returns
+* the stack it was sampled at, NULL if it wasn't. Only the freeing thread
+* may hold a live block, so its slot can't change meanwhile
+*/
+ProfStack* dropSample(void* ptr) {
+  size_t set = sampleSet(ptr);
+  for (size_t i = set; i < set + PROF_WAYS; i++) {
+    if (atomic_load_explicit(&sampleKeys[i], memory_order_relaxed) == ptr) {
+      pthread_mutex_lock(&profLock);
+      ProfStack* stack = sampleStacks[i];
+      stack->liveCount--;
+      stack->liveBytes -= sampleSizes[i];
+      atomic_store_explicit(&sampleKeys[i], NULL, memory_order_relaxed);
+      atomic_fetch_sub_explicit(&nSamples, 1, memory_order_relaxed);
+      pthread_mutex_unlock(&profLock);
+      return stack;
+    }
+  }
+  return NULL;
+}
+
+/*
+* Makes "ptr", now "size" bytes, a live sample of "stack" again, after
+* dropSample() took it out while its block was resized in place. Not counted
+* as a new allocation
+*/
+void restoreSample(void* ptr, ProfStack* stack, size_t size) {
+  pthread_mutex_lock(&profLock);
+  size_t set = sampleSet(ptr);
+  for (size_t i = set; i < set + PROF_WAYS; i++) {
+    if (atomic_load_explicit(&sampleKeys[i], memory_order_relaxed) == NULL) {
+      sampleStacks[i] = stack;
+      sampleSizes[i] = size;
+      stack->liveCount++;
+      stack->liveBytes += size;
+      atomic_store_explicit(&sampleKeys[i], ptr, memory_order_relaxed);
+      atomic_fetch_add_explicit(&nSamples, 1, memory_order_relaxed);
+      break;
+    }
+  }
+  pthread_mutex_unlock(&profLock);
+}
+
+/*
+* Drops "ptr" from the live samples before it is freed, a single load unless
+* the profiler has any
+*/
+inline static void unsample(void* ptr) {
+  if (__builtin_expect(atomic_load_explicit(&nSamples, memory_order_relaxed) != 0, 0)) {
+    dropSample(ptr);
+  }
+}
+
+/*
+* Samples, then traces, an allocation by call "op" of "size" bytes at "ptr"
+*/
+inline static void noteAllocation(int op, void* ptr, size_t size, size_t alignment) {
+  countSample(ptr, size);
+  if (tracing()) {
+    traceCall(op, ptr, size, alignment);
+  }
+}
+
+/*
+* Counts an allocation of "bytes" usable bytes in stats bin "bin"
+*/
+inline static void countAlloc(ThreadCache* tc, int bin, size_t bytes) {
+  BinStats* stats = &tc->stats->bins[bin];
+  addStat(&stats->nmalloc, 1);
+  addStat(&stats->allocated, bytes);
+}
+
+/*
+* Counts a free of "bytes" usable bytes in stats bin "bin"
+*/
+inline static void countFree(ThreadCache* tc, int bin, size_t bytes) {
+  BinStats* stats = &tc->stats->bins[bin];
+  addStat(&stats->nfree, 1);
+  addStat(&stats->freed, bytes);
+}
+
+/*
+* Returns the usable bytes of allocated block "block"
+*/
+size_t blockUsable(MetaBlock* block) {
+  return tagSize(block) - kMetaBlockSize;
+}
+
+/*
+* Returns the stats bin of allocated blocks of "size" bytes (tags included),
+* the one of the cache bin my_free puts them in
+*/
+int sizeStatBin(size_t size) {
+  size_t binIdx = size >> kCacheBinShift;
+  return binIdx < N_CACHE_BINS ? N_SLAB_CLASSES + binIdx : STAT_LARGE;
+}
+
+/*
+* Returns the stats bin of allocated block "block" of a block chunk
+*/
+int blockStatBin(MetaBlock* block) {
+  return sizeStatBin(tagSize(block));
+}
+
+/*
+* Reports an invalid pointer passed to "func" and exits. Writes to stderr
+* directly, stdio may allocate and so recurse into us when we stand in for
+* malloc
+*/
+void invalidPointer(const char* func) {
+  errno = EINVAL;
+  const char* reason = strerror(errno);
+
+  char msg[128];
+  size_t len = 0;
+  const char* parts[] = {func, ": ", reason, "\n"};
+  for (size_t i = 0; i < sizeof(parts) / sizeof(parts[0]); i++) {
+    size_t n = strlen(parts[i]);
+    if (len + n > sizeof(msg)) {
+      n = sizeof(msg) - len;
+    }
+    memcpy(msg + len, parts[i], n);
+    len += n;
+  }
+  ssize_t written = write(STDERR_FILENO, msg, len);
+  (void) written;
+  exit(1);
+}
+
+/*
+* Returns the usable bytes of the live allocation at "ptr"
+*/
+size_t usableSize(void* ptr) {
+  PageEntry entry = getEntry(ptr);
+  if (entryKind(entry) == SLAB_CHUNK) {
+    return slabClassSize(entrySlabClass(entry));
+  }
+  return blockUsable((MetaBlock*) (((size_t) ptr) - sizeof(MetaBlock)));
+}
+
+/*
+* Returns the block size, tags included, that holds a "size" byte request
+*/
+size_t blockSize(size_t size) {
+  // Aligning and providing minimum for size
+  size = round_up(size + kMetaBlockSize, kBlockAlignment);
+  if (size < kPointerBlockSize) {
+    size = round_up(kPointerBlockSize, kBlockAlignment);
+  }
+  return size;
+}
+
+/*
+* Maps a huge chunk for "size" bytes whose payload is aligned to
+* "alignment". Returns the payload, or NULL if the mapping fails
+*/
+void* allocateHuge(Arena* arena, size_t size, size_t alignment) {
+  // Chunks are ARENA_SIZE aligned, so up to that the lead is known before
+  // mapping, past it room for any lead is mapped
+  const size_t headers = kChunkHeaderSize + 2*sizeof(MetaBlock);
+  size_t lead = alignment <= ARENA_SIZE ? round_up(headers, alignment) - headers : alignment;
+
+  // Huge chunks only enter and leave the page map under their arena's
+  // lock, so a heap walk never sees one half set up or unmapped
+  pthread_mutex_lock(&arena->lock);
+  Chunk* chunk = newChunk(arena, hugeChunkSize(size, lead), HUGE_CHUNK);
+  if (chunk == NULL) {
+    pthread_mutex_unlock(&arena->lock);
+    errno = ENOMEM;
+    return NULL;
+  }
+
+  // The pages mapped run up to the payload, which the lead may push further
+  chunk->lead = round_up(((size_t) chunk) + headers, alignment) - ((size_t) chunk) - headers;
+  if (!setChunk(chunk)) {
+    unmapChunk(chunk);
+    pthread_mutex_unlock(&arena->lock);
+    errno = ENOMEM;
+    return NULL;
+  }
+  MetaBlock* block = fillChunk(chunk);
+  pthread_mutex_unlock(&arena->lock);
+  return (void*) (((size_t) block) + sizeof(MetaBlock));
+}
+
+/*
+* Allocates "size" bytes, setting "zeroed" (if given) when the memory is
+* known to still be zero apart from its first kFreeLinksSize bytes and its
+* last word
+*/
+void* allocate(size_t size, bool* zeroed) {
+  // Checking is size is valid
+  if (size == 0) {
+    return NULL;
+  }
+  if (size > kMaxAllocationSize) {
+    errno = ENOMEM;
+    return NULL;
+  }
+
+  ThreadCache* tc = getThreadCache();
+  if (zeroed != NULL) {
+    *zeroed = false;
+  }
+
+  // Huge requests are mapped on their own, fresh from the OS
+  if (size >= hugeThreshold) {
+    void* out = allocateHuge(tc->arena, size, kAlignment);
+    if (zeroed != NULL) {
+      *zeroed = out != NULL;
+    }
+    if (out != NULL) {
+      countAlloc(tc, STAT_HUGE, usableSize(out));
+    }
+    return out;
+  }
+
+  // Small requests are slab objects, taken from this thread's cache
+  if (size <= kSlabMaxSize) {
+    int sizeClass = slabClass(size);
+    CacheBin* bin = &tc->slabBins[sizeClass];
+    if (bin->head == NULL) {
+      refillSlabBin(tc->arena, bin, sizeClass);
+      if (bin->head == NULL) {
+        errno = ENOMEM;
+        return NULL;
+      }
+    }
+    void** link = bin->head;
+    bin->head = *link;
+    bin->count--;
+    if (sizeClass > 0) {
+      link[1] = NULL;
+    }
+
+    countAlloc(tc, sizeClass, slabClassSize(sizeClass));
+    return link;
+  }
+
+  size = blockSize(size);
+
+  MetaBlock* curr;
+  size_t binIdx = round_up(size, 1 << kCacheBinShift) >> kCacheBinShift;
+
+  if (binIdx < N_CACHE_BINS) {
+    // Small blocks come from this thread's cache, which only locks to refill
+    size = binIdx << kCacheBinShift;
+    CacheBin* bin = &tc->bins[binIdx];
+    if (bin->head == NULL) {
+      refillCacheBin(tc->arena, bin, size);
+      if (bin->head == NULL) {
+        errno = ENOMEM;
+        return NULL;
+      }
+    }
+    void** link = bin->head;
+    bin->head = *link;
+    bin->count--;
+    // Unmarked, so its next free doesn't search the bin for it
+    link[1] = NULL;
+    curr = (MetaBlock*) (((size_t) link) - sizeof(MetaBlock));
+  } else {
+    pthread_mutex_lock(&tc->arena->lock);
+    collectRemoteFrees(tc->arena);
+    curr = allocateBlock(tc->arena, size, zeroed);
+    pthread_mutex_unlock(&tc->arena->lock);
+    if (curr == NULL) {
+      return NULL;
+    }
+  }
+
+  countAlloc(tc, blockStatBin(curr), blockUsable(curr));
+  return (void*) (((size_t) curr) + sizeof(MetaBlock));
+}
+
+/*
+* Given a size, allocates memory using mmap and returns starting address.
+* The memory is not cleared
+*/
+void *my_malloc(size_t size)
+{
+  void* out = allocate(size, NULL);
+  if (out != NULL) {
+    noteAllocation(MY_TRACE_MALLOC, out, size, 0);
+  }
+  return out;
+}
+
+/*
+* Allocates zeroed memory for "nmemb" elements of "size" bytes. Blocks that
+* are known to still be zero only clear the free block links and footer
+* they held
+*/
+void *my_calloc(size_t nmemb, size_t size)
+{
+  size_t total;
+  if (__builtin_mul_overflow(nmemb, size, &total)) {
+    errno = ENOMEM;
+    return NULL;
+  }
+
+  bool zeroed;
+  void* out = allocate(total, &zeroed);
+  if (out == NULL) {
+    return NULL;
+  }
+
+  // Anything that may be dirty is cleared with libc's vectorised memset
+  if (zeroed) {
+    MetaBlock* block = (MetaBlock*) (((size_t) out) - sizeof(MetaBlock));
+    size_t payload = blockUsable(block);
+    memset(out, 0, payload < kFreeLinksSize ? payload : kFreeLinksSize);
+    memset(((char*) out) + payload - sizeof(MetaBlock), 0, sizeof(MetaBlock));
+  } else {
+    memset(out, 0, total);
+  }
+  noteAllocation(MY_TRACE_CALLOC, out, total, 0);
+  return out;
+}
+
+/*
+* Exits with an error, reported for "func", if "link" is on "bin" already,
+* being freed twice
+*/
+void checkNotCached(CacheBin* bin, void** link, const char* func) {
+  for (void** cached = bin->head; cached != NULL; cached = *cached) {
+    if (cached == link) {
+      invalidPointer(func);
+    }
+  }
+}
+
+/*
+* Pushes "ptr" onto one of the calling thread's cache bins, flushing half of
+* the bin back to the arena when it is full. A "marked" object gets the
+* cache cookie after its link, and is only searched for in the bin if it
+* has it already
+*/
+void cacheFree(ThreadCache* tc, CacheBin* bin, void* ptr, bool marked) {
+  void** link = ptr;
+  if (marked) {
+    if (__builtin_expect(link[1] == (void*) cacheCookie, 0)) {
+      checkNotCached(bin, link, "my_free");
+    }
+    link[1] = (void*) cacheCookie;
+  } else {
+#ifdef MYMALLOC_DEBUG
+    // 8 byte slab objects have no room for the cookie, debug builds search
+    // the bin on every free instead
+    checkNotCached(bin, link, "my_free");
+#endif
+  }
+  *link = bin->head;
+  bin->head = link;
+  bin->count++;
+  if (bin->count > kCacheBinMax) {
+    flushCacheBin(tc->arena, bin, kCacheBinMax / 2);
+  }
+}
+
+/*
+* Exits with an error, reported for "func", if the allocation at "ptr",
+* whose page has "entry", is on its owner's remote free list or the calling
+* thread's cache, still marked in use after my_free. Searches the bin
+* cacheFree() would have used, under the same conditions
+*/
+void checkNotFreed(ThreadCache* tc, PageEntry entry, void* ptr, const char* func) {
+  void** link = ptr;
+  if (hasCookie(entry) && __builtin_expect(link[1] == (void*) remoteCookie, 0)) {
+    invalidPointer(func);
+  }
+  if (entryArena(entry) != tc->arena) {
+    return;
+  }
+  if (entryKind(entry) == SLAB_CHUNK) {
+    int sizeClass = entrySlabClass(entry);
+#ifndef MYMALLOC_DEBUG
+    if (sizeClass == 0) {
+      return;
+    }
+#endif
+    if (sizeClass == 0 || link[1] == (void*) cacheCookie) {
+      checkNotCached(&tc->slabBins[sizeClass], link, func);
+    }
+  } else if (entryKind(entry) == BLOCK_CHUNK) {
+    int statBin = blockStatBin((MetaBlock*) (((size_t) ptr) - sizeof(MetaBlock)));
+    if (statBin != STAT_LARGE && link[1] == (void*) cacheCookie) {
+      checkNotCached(&tc->bins[statBin - N_SLAB_CLASSES], link, func);
+    }
+  }
+}
+
+/*
+* Frees the live allocation at "ptr", whose page has "entry" in the page
+* map. The entry names the owner and slab class. A block's size, tags
+* included, is "size", or read from its header if that is 0
+*/
+void freeEntry(PageEntry entry, void* ptr, size_t size) {
+  unsample(ptr);
+
+  // Block to be removed if criteria is met
+  MetaBlock* toRemove = (MetaBlock*) (((size_t) ptr) - sizeof(MetaBlock));
+  ThreadCache* tc = getThreadCache();
+  Arena* owner = entryArena(entry);
+  ChunkKind kind = entryKind(entry);
+
+  // Huge chunks go straight back to the OS
+  if (kind == HUGE_CHUNK) {
+    countFree(tc, STAT_HUGE, blockUsable(toRemove));
+    pthread_mutex_lock(&owner->lock);
+    unmapChunk(entryChunk(entry));
+    pthread_mutex_unlock(&owner->lock);
+    return;
+  }
+
+  int statBin;
+  if (kind == SLAB_CHUNK) {
+    statBin = entrySlabClass(entry);
+    countFree(tc, statBin, slabClassSize(statBin));
+  } else {
+    if (size == 0) {
+      size = tagSize(toRemove);
+    }
+    statBin = sizeStatBin(size);
+    countFree(tc, statBin, size - kMetaBlockSize);
+  }
+
+  // A block already pushed onto its owner's remote list has the remote
+  // cookie
+  bool marked = hasCookie(entry);
+  if (marked && __builtin_expect(((void**) ptr)[1] == (void*) remoteCookie, 0)) {
+    invalidPointer("my_free");
+  }
+
+  // Blocks of other arenas are handed back to their owner without locking
+  if (owner != tc->arena) {
+    pushRemoteFree(owner, ptr, marked);
+    return;
+  }
+
+  // Slab objects and small blocks stay allocated in this thread's cache,
+  // whose bins line up with the stats bins. Marked ones get the cache
+  // cookie there
+  if (kind == SLAB_CHUNK) {
+    cacheFree(tc, &tc->slabBins[statBin], ptr, marked);
+    return;
+  }
+  if (statBin != STAT_LARGE) {
+    cacheFree(tc, &tc->bins[statBin - N_SLAB_CLASSES], ptr, marked);
+    return;
+  }
+
+  // Everything else goes straight back to the free lists
+  pthread_mutex_lock(&owner->lock);
+  freeBlock(owner, toRemove);
+  purgeDirty(owner, false);
+  pthread_mutex_unlock(&owner->lock);
+}
+
+/*
+* Given a pointer, assumed to be start of allocated block, frees that block
+* and re-inserts it into the relevant free-list
+*/
+void freeAllocation(void* ptr) {
+  // If pointer is NULL/allocated, or not in any of our chunks, throw error
+  PageEntry entry = getEntry(ptr);
+  if (!isAllocated(entry, ptr)) {
+    invalidPointer("my_free");
+  }
+  freeEntry(entry, ptr, 0);
+}
+
+/*
+* Resizes the allocation at "ptr" to "size" bytes, neither of them zero,
+* keeping its contents. Blocks shrink or grow in place when they can, huge
+* blocks by remapping their chunk, anything else moves to a new allocation
+*/
+void* reallocate(void* ptr, size_t size) {
+  if (size > kMaxAllocationSize) {
+    errno = ENOMEM;
+    return NULL;
+  }
+
+  // Same checks as my_free
+  PageEntry entry = getEntry(ptr);
+  if (!isAllocated(entry, ptr)) {
+    invalidPointer("my_realloc");
+  }
+  Chunk* chunk = entryChunk(entry);
+
+  size_t oldSize;
+  if (entryKind(entry) == SLAB_CHUNK) {
+    // Slab objects can't change size, but may already be big enough
+    oldSize = slabClassSize(entrySlabClass(entry));
+    if (size <= oldSize) {
+      return ptr;
+    }
+  } else if (entryKind(entry) == HUGE_CHUNK) {
+    MetaBlock* curr = (MetaBlock*) (((size_t) ptr) - sizeof(MetaBlock));
+    oldSize = blockUsable(curr);
+
+    // Nothing else lives in the chunk, the owner's lock only keeps heap
+    // walks off it. Blocks shrinking below the threshold move back into an
+    // arena
+    if (size >= hugeThreshold) {
+      // The mapping may move, and its old address be sampled by another
+      // thread, so a sample is taken out first and put back if it stays
+      ProfStack* sampled = NULL;
+      if (atomic_load_explicit(&nSamples, memory_order_relaxed) != 0) {
+        sampled = dropSample(ptr);
+      }
+      Arena* owner = entryArena(entry);
+      pthread_mutex_lock(&owner->lock);
+      Chunk* moved = remapChunk(chunk, hugeChunkSize(size, chunk->lead));
+      MetaBlock* block = moved != NULL ? fillChunk(moved) : NULL;
+      pthread_mutex_unlock(&owner->lock);
+      if (block != NULL) {
+        ThreadCache* tc = getThreadCache();
+        countFree(tc, STAT_HUGE, oldSize);
+        countAlloc(tc, STAT_HUGE, blockUsable(block));
+        void* out = (void*) (((size_t) block) + sizeof(MetaBlock));
+        if (sampled != NULL && out == ptr) {
+          restoreSample(out, sampled, size);
+        }
+        return out;
+      }
+    }
+  } else {
+    MetaBlock* curr = (MetaBlock*) (((size_t) ptr) - sizeof(MetaBlock));
+    oldSize = blockUsable(curr);
+
+    // Blocks growing past the threshold move to a huge chunk instead
+    if (size < hugeThreshold) {
+      Arena* owner = entryArena(entry);
+      int oldBin = blockStatBin(curr);
+      pthread_mutex_lock(&owner->lock);
+      bool resized = resizeBlock(owner, curr, blockSize(size));
+      pthread_mutex_unlock(&owner->lock);
+      if (resized) {
+        ThreadCache* tc = getThreadCache();
+        countFree(tc, oldBin, oldSize);
+        countAlloc(tc, blockStatBin(curr), blockUsable(curr));
+        return ptr;
+      }
+    }
+  }
+
+  void* out = allocate(size, NULL);
+  if (out == NULL) {
+    return NULL;
+  }
+  memcpy(out, ptr, oldSize < size ? oldSize : size);
+  freeAllocation(ptr);
+  return out;
+}
+
+/*
+* Resizes the allocation at "ptr" to "size" bytes, keeping its contents. A
+* NULL "ptr" makes it my_malloc, a zero "size" my_free
+*/
+void *my_realloc(void *ptr, size_t size)
+{
+  if (ptr == NULL) {
+    return my_malloc(size);
+  }
+  if (size == 0) {
+    my_free(ptr);
+    return NULL;
+  }
+  bool traced = tracing();
+  if (traced) {
+    traceCall(MY_TRACE_REALLOC_FROM, ptr, size, 0);
+  }
+  void* out = reallocate(ptr, size);
+  // Blocks that moved count as new allocations
+  if (out != NULL && out != ptr) {
+    countSample(out, size);
+  }
+  if (traced) {
+    traceCall(MY_TRACE_REALLOC, out, size, 0);
+  }
+  return out;
+}
+
+/*
+* Allocates "size" bytes aligned to "alignment", a power of two. Slab classes
+* that are a multiple of the alignment are aligned already, otherwise the
+* block is carved at an aligned offset so no slack stays allocated
+*/
+void* allocateAligned(size_t size, size_t alignment) {
+  if (alignment <= kAlignment) {
+    return allocate(size, NULL);
+  }
+  if (size == 0) {
+    return NULL;
+  }
+  if (size > kMaxAllocationSize - alignment) {
+    errno = ENOMEM;
+    return NULL;
+  }
+  if (alignment <= kSlabMaxAlignment && round_up(size, alignment) <= kSlabMaxSize) {
+    return allocate(round_up(size, alignment), NULL);
+  }
+
+  ThreadCache* tc = getThreadCache();
+
+  // Too big to carve from the free lists, the lead of a huge chunk aligns it
+  if (blockSize(size) + alignment >= hugeThreshold) {
+    void* out = allocateHuge(tc->arena, size, alignment);
+    if (out != NULL) {
+      countAlloc(tc, STAT_HUGE, usableSize(out));
+    }
+    return out;
+  }
+
+  pthread_mutex_lock(&tc->arena->lock);
+  collectRemoteFrees(tc->arena);
+  MetaBlock* curr = allocateAlignedBlock(tc->arena, blockSize(size), alignment);
+  pthread_mutex_unlock(&tc->arena->lock);
+  if (curr == NULL) {
+    return NULL;
+  }
+  countAlloc(tc, blockStatBin(curr), blockUsable(curr));
+  return (void*) (((size_t) curr) + sizeof(MetaBlock));
+}
+
+/*
+* Allocates "size" bytes aligned to "alignment", which must be a power of two
+*/
+void *my_memalign(size_t alignment, size_t size)
+{
+  if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+    errno = EINVAL;
+    return NULL;
+  }
+  void* out = allocateAligned(size, alignment);
+  if (out != NULL) {
+    noteAllocation(MY_TRACE_MEMALIGN, out, size, alignment);
+  }
+  return out;
+}
+
+/*
+* C11 aligned_alloc, the same as my_memalign
+*/
+void *my_aligned_alloc(size_t alignment, size_t size)
+{
+  return my_memalign(alignment, size);
+}
+
+/*
+* Stores "size" bytes aligned to "alignment" in "memptr". The alignment must
+* be a power of two multiple of sizeof(void*), returns EINVAL if it isn't
+* and ENOMEM if there's no memory, leaving errno alone
+*/
+int my_posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+  if (alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0 || alignment == 0) {
+    return EINVAL;
+  }
+  if (size == 0) {
+    *memptr = NULL;
+    return 0;
+  }
+
+  int saved = errno;
+  void* out = allocateAligned(size, alignment);
+  errno = saved;
+  if (out == NULL) {
+    return ENOMEM;
+  }
+  noteAllocation(MY_TRACE_MEMALIGN, out, size, alignment);
+  *memptr = out;
+  return 0;
+}
+
+/*
+* Frees the allocation at "ptr", if it isn't NULL
+*/
+void my_free(void *ptr)
+{
+  if (ptr == NULL) {
+    return;
+  }
+  if (tracing()) {
+    traceCall(MY_TRACE_FREE, ptr, 0, 0);
+  }
+  freeAllocation(ptr);
+}
+
+/*
+* Frees "ptr" given a "size" between the one it was allocated with and its
+* usable size. Blocks are cut to exactly the size allocate() rounds any of
+* those to, so a block's cache bin and stats come from "size" without
+* reading its header. Only debug builds check the pointer, and the size
+* against the header
+*/
+void my_free_sized(void *ptr, size_t size)
+{
+  if (ptr == NULL) {
+    return;
+  }
+  if (tracing()) {
+    traceCall(MY_TRACE_FREE, ptr, size, 0);
+  }
+  PageEntry entry = getEntry(ptr);
+#ifdef MYMALLOC_DEBUG
+  if (!isAllocated(entry, ptr) || size == 0 || size > usableSize(ptr) ||
+      (entryKind(entry) == BLOCK_CHUNK &&
+       blockSize(size) != tagSize((MetaBlock*) (((size_t) ptr) - sizeof(MetaBlock))))) {
+    invalidPointer("my_free_sized");
+  }
+#endif
+
+  // Pointers of no chunk are left to my_free to turn away. Slab objects,
+  // memalign's among them, may be of a bigger class than "size" maps to,
+  // so theirs comes from the page map
+  if (entry == 0) {
+    freeAllocation(ptr);
+    return;
+  }
+  freeEntry(entry, ptr, entryKind(entry) == BLOCK_CHUNK ? blockSize(size) : 0);
+}
+
+/*
+* Returns the usable bytes of the allocation at "ptr", at least what was asked
+* for, and 0 for NULL
+*/
+size_t my_malloc_usable_size(void *ptr)
+{
+  return ptr == NULL ? 0 : usableSize(ptr);
+}
+
+/*
+* Allocates at least "size" bytes like my_malloc, storing the usable size,
+* which rounding may make larger, in "actual"
+*/
+void *my_malloc_at_least(size_t size, size_t *actual)
+{
+  void* out = my_malloc(size);
+  if (out != NULL && actual != NULL) {
+    *actual = usableSize(out);
+  }
+  return out;
+}
+
+/*
+* Allocates "n" objects of "size" bytes into "out", taking the arena's lock
+* once: slab objects after the thread cache runs dry, blocks carved in
+* runs from single free blocks. Returns how many were allocated, fewer than
+* "n" only if memory runs out
+*/
+size_t allocateBatch(size_t size, size_t n, void** out) {
+  if (size == 0 || size >= hugeThreshold || size > kMaxAllocationSize) {
+    size_t i = 0;
+    while (i < n && (out[i] = allocate(size, NULL)) != NULL) {
+      i++;
+    }
+    return i;
+  }
+
+  ThreadCache* tc = getThreadCache();
+  size_t i = 0;
+
+  if (size <= kSlabMaxSize) {
+    int sizeClass = slabClass(size);
+    CacheBin* bin = &tc->slabBins[sizeClass];
+    while (i < n && bin->head != NULL) {
+      void** link = bin->head;
+      bin->head = *link;
+      bin->count--;
+      if (sizeClass > 0) {
+        link[1] = NULL;
+      }
+      out[i++] = link;
+    }
+
+    pthread_mutex_lock(&tc->arena->lock);
+    collectRemoteFrees(tc->arena);
+    while (i < n && (out[i] = slabAlloc(tc->arena, sizeClass)) != NULL) {
+      i++;
+    }
+    pthread_mutex_unlock(&tc->arena->lock);
+
+    for (size_t j = 0; j < i; j++) {
+      countAlloc(tc, sizeClass, slabClassSize(sizeClass));
+    }
+    return i;
+  }
+
+  // Same block size my_malloc would use, so the blocks cache alike
+  size = blockSize(size);
+  size_t binIdx = round_up(size, 1 << kCacheBinShift) >> kCacheBinShift;
+  if (binIdx < N_CACHE_BINS) {
+    size = binIdx << kCacheBinShift;
+  }
+
+  // Runs stay well inside one chunk
+  size_t perRun = (ARENA_SIZE / 4) / size;
+  if (perRun == 0) {
+    perRun = 1;
+  }
+
+  pthread_mutex_lock(&tc->arena->lock);
+  collectRemoteFrees(tc->arena);
+  while (i < n) {
+    size_t count = n - i < perRun ? n - i : perRun;
+    if (!allocateBlockRun(tc->arena, size, count, out + i)) {
+      break;
+    }
+    i += count;
+  }
+  pthread_mutex_unlock(&tc->arena->lock);
 
-// Align sizes for faster operations
-inline static size_t round_up(size_t size, size_t alignment) {
-  const size_t mask = alignment - 1;
-  return (size + mask) & ~mask;
+  for (size_t j = 0; j < i; j++) {
+    MetaBlock* block = (MetaBlock*) (((size_t) out[j]) - sizeof(MetaBlock));
+    countAlloc(tc, blockStatBin(block), blockUsable(block));
+  }
+  return i;
 }
 
 /*
-* Given a (presumed) free block's LEFT metadata block, finds the pointer block
+* Records each non-NULL pointer of a batch as a call of "op" of its own
 */
-PointerBlock* getPointers(MetaBlock* block) {
-  if (block == NULL) {
-    return NULL;
+void traceBatch(int op, void** ptrs, size_t n, size_t size) {
+  for (size_t i = 0; i < n; i++) {
+    if (ptrs[i] != NULL) {
+      traceCall(op, ptrs[i], size, 0);
+    }
   }
+}
 
-  // Go to end of block, take away MetaBlock and Pointer to get to start of Pointer.
-  PointerBlock* outpp = (PointerBlock*) (((size_t) block) + (block->size - sizeof(MetaBlock) - sizeof(PointerBlock)));
+/*
+* Allocates "n" objects of "size" bytes into "out" like "n" calls of
+* my_malloc, returning how many were allocated
+*/
+size_t my_malloc_batch(size_t size, size_t n, void **out)
+{
+  size_t allocated = allocateBatch(size, n, out);
+  for (size_t i = 0; i < allocated; i++) {
+    countSample(out[i], size);
+  }
+  if (tracing()) {
+    traceBatch(MY_TRACE_MALLOC, out, allocated, size);
+  }
+  return allocated;
+}
 
-  return outpp;
+/*
+* Sorts "n" pointers by address, in place with a heap sort, since qsort may
+* allocate
+*/
+void sortPointers(void** ptrs, size_t n) {
+  for (size_t end = n; end > 1; end--) {
+    // Build the max heap on the first pass, then restore it from the root
+    size_t start = end == n ? n / 2 : 1;
+    while (start > 0) {
+      start--;
+      size_t root = start;
+      size_t child;
+      while ((child = 2 * root + 1) < end) {
+        if (child + 1 < end && (size_t) ptrs[child + 1] > (size_t) ptrs[child]) {
+          child++;
+        }
+        if ((size_t) ptrs[root] >= (size_t) ptrs[child]) {
+          break;
+        }
+        void* tmp = ptrs[root];
+        ptrs[root] = ptrs[child];
+        ptrs[child] = tmp;
+        root = child;
+      }
+    }
+    void* tmp = ptrs[0];
+    ptrs[0] = ptrs[end - 1];
+    ptrs[end - 1] = tmp;
+  }
 }
 
 /*
-* Initialise free block for all space as a single free block
+* Frees "n" pointers at once. Sorted by address, neighbouring blocks merge
+* into one before a single coalesce, and each arena is locked once per run
+* of its pointers. Reorders "ptrs", NULLs are skipped
 */
-MetaBlock* initialise(int m) {
-  // Allocating Initial Memory
-  MetaBlock* init = mmap(NULL, m*ARENA_SIZE, 
-                        PROT_READ | PROT_WRITE,
-                        MAP_PRIVATE | MAP_ANONYMOUS, 0, 0);
+void my_free_batch(void **ptrs, size_t n)
+{
+  if (tracing()) {
+    traceBatch(MY_TRACE_FREE, ptrs, n, 0);
+  }
+  sortPointers(ptrs, n);
 
-  if (init == NULL) {
-    return NULL;
+  // Check everything first, a repeat shows up as neighbours after sorting,
+  // and blocks my_free cached as still in use are found in their bin
+  ThreadCache* tc = getThreadCache();
+  for (size_t i = 0; i < n; i++) {
+    if (ptrs[i] == NULL) {
+      continue;
+    }
+    PageEntry entry = getEntry(ptrs[i]);
+    if (!isAllocated(entry, ptrs[i]) || (i > 0 && ptrs[i] == ptrs[i - 1])) {
+      invalidPointer("my_free_batch");
+    }
+    checkNotFreed(tc, entry, ptrs[i], "my_free_batch");
+    unsample(ptrs[i]);
   }
 
-  // Init is left most, indicated by kMemorySize
-  init->size = kMemorySize;
+  Arena* locked = NULL;
+  size_t i = 0;
+  while (i < n) {
+    void* ptr = ptrs[i++];
+    if (ptr == NULL) {
+      continue;
+    }
+    PageEntry entry = getEntry(ptr);
+    // Huge chunks are unmapped under their owner's lock, so the one held
+    // is dropped first
+    if (entryKind(entry) == HUGE_CHUNK) {
+      if (locked != NULL) {
+        purgeDirty(locked, false);
+        pthread_mutex_unlock(&locked->lock);
+        locked = NULL;
+      }
+      freeAllocation(ptr);
+      continue;
+    }
 
-  // Go to the end, subtract Metablock for right_fp
-  MetaBlock* right_fp = (MetaBlock*) (((size_t) init) + m*ARENA_SIZE - sizeof(MetaBlock));
-  right_fp->size = kMemorySize;
+    if (entryArena(entry) != locked) {
+      if (locked != NULL) {
+        purgeDirty(locked, false);
+        pthread_mutex_unlock(&locked->lock);
+      }
+      locked = entryArena(entry);
+      pthread_mutex_lock(&locked->lock);
+    }
 
-  // Freelist starts after left_fp
-  init = (MetaBlock*) (((size_t) init) + sizeof(MetaBlock));
-  init->size = m*ARENA_SIZE - 2*sizeof(MetaBlock);
+    if (entryKind(entry) == SLAB_CHUNK) {
+      int sizeClass = entrySlabClass(entry);
+      countFree(tc, sizeClass, slabClassSize(sizeClass));
+      slabFree(locked, ptr);
+      continue;
+    }
 
-  // Specify pointers, since it is free, both to NULL
-  PointerBlock* init_ptr = getPointers(init);
-  init_ptr->prev = NULL;
-  init_ptr->next = NULL;
+    // Absorb the blocks that follow this one directly, then free them as one
+    MetaBlock* block = (MetaBlock*) (((size_t) ptr) - sizeof(MetaBlock));
+    countFree(tc, blockStatBin(block), blockUsable(block));
+    size_t size = tagSize(block);
+    while (i < n && ((size_t) ptrs[i]) == ((size_t) ptr) + size) {
+      MetaBlock* next = (MetaBlock*) (((size_t) ptrs[i]) - sizeof(MetaBlock));
+      countFree(tc, blockStatBin(next), blockUsable(next));
+      size += tagSize(next);
+      i++;
+    }
+    block->size = size | (block->size & (kInUse | kPrevInUse));
+    freeBlock(locked, block);
+  }
+
+  if (locked != NULL) {
+    purgeDirty(locked, false);
+    pthread_mutex_unlock(&locked->lock);
+  }
+}
 
+// Regions start out with chunks this big, each new one twice the last, up
+// to kRegionChunkMax. Objects over a quarter of a chunk get a block each
+const size_t kRegionChunkMin = 4096;
+const size_t kRegionChunkMax = 256 * 1024;
 
-  // Add footer tag
-  MetaBlock* freeListEnd = (MetaBlock*) (((size_t) init) + init->size - sizeof(MetaBlock));
-  freeListEnd->size = m*ARENA_SIZE - 2*sizeof(MetaBlock);
+// Heads every chunk a region has taken from the heap besides the one the
+// region itself lives in
+typedef struct RegionChunk {
+  struct RegionChunk* next;
+} RegionChunk;
 
-  return init;
+// Bump pointer into the current chunk, and every chunk to free on reset.
+// Lives at the start of its first chunk, which it never gives up
+struct my_region {
+  char* next;
+  char* end;
+  RegionChunk* chunks;
+  size_t chunkSize;
+  char* firstEnd;
+};
+
+/*
+* Returns the word aligned end of the usable bytes of "block"
+*/
+char* regionEnd(void* block) {
+  return (char*) ((((size_t) block) + usableSize(block)) & ~(kAlignment - 1));
 }
 
 /*
-* Given the left metadata block, returns the right metadata block
-* Assumes that the block is unallocated
+* Creates an empty region in a chunk of its own
 */
-MetaBlock* getRightMetaBlock(MetaBlock* block) {
-  if (block == NULL) {
+my_region *my_region_create(void)
+{
+  my_region* region = my_malloc(kRegionChunkMin);
+  if (region == NULL) {
     return NULL;
   }
-
-  // Adding size to go to end, then taking away MetaBlock size
-  MetaBlock* new = (MetaBlock*) (((size_t) block) + block->size - sizeof(MetaBlock));
-  return new;
+  region->next = (char*) round_up((size_t) (region + 1), kAlignment);
+  region->end = region->firstEnd = regionEnd(region);
+  region->chunks = NULL;
+  region->chunkSize = kRegionChunkMin;
+  return region;
 }
 
 /*
-* Splits a large block "curr" into 2 blocks, where "size" is the size of the
-* first block. Only updates the tags of the second block
+* Takes "size" bytes from a new chunk when the current one is full. Big
+* objects get a chunk of their own, which the bump pointer leaves alone
 */
-MetaBlock* splitBlock(MetaBlock* curr, size_t size) {
-  size_t size_before = curr->size;
-
-  // Finding second block
-  MetaBlock* newBlock = (MetaBlock*) (((size_t) curr) + size);
+void* regionRefill(my_region* region, size_t size) {
+  size_t header = round_up(sizeof(RegionChunk), kAlignment);
+  if (size > kMaxAllocationSize - header) {
+    errno = ENOMEM;
+    return NULL;
+  }
+  size = round_up(size, kAlignment);
 
-  // Updating boundary tags for second block only
-  newBlock->size = size_before - size;
-  MetaBlock* newBlockRight = getRightMetaBlock(newBlock);
-  newBlockRight->size = size_before - size;
+  size_t chunkSize = region->chunkSize;
+  bool own = size > chunkSize / 4;
+  RegionChunk* chunk = my_malloc(own ? header + size : chunkSize);
+  if (chunk == NULL) {
+    return NULL;
+  }
+  chunk->next = region->chunks;
+  region->chunks = chunk;
 
-  return newBlock;
+  char* out = ((char*) chunk) + header;
+  if (!own) {
+    region->next = out + size;
+    region->end = regionEnd(chunk);
+    if (chunkSize < kRegionChunkMax) {
+      region->chunkSize = chunkSize * 2;
+    }
+  }
+  return out;
 }
 
-/* 
-* Return the index of the freeList array representing which free list a block
-* will go in. Assumes a max size of 8 (index 7)
+/*
+* Allocates "size" bytes from "region", word aligned and without a header.
+* They stay until the region is reset or destroyed
 */
-int getIndex(size_t size) {
-  // First bin is for <64 bytes, store initial index for this
-  int out = 0;
-  size_t pow = 64;
+void *my_region_alloc(my_region *region, size_t size)
+{
+  // Both ends are word aligned, so the rounded size fits too
+  if (__builtin_expect(size <= (size_t) (region->end - region->next), 1)) {
+    void* out = region->next;
+    region->next += round_up(size, kAlignment);
+    return out;
+  }
+  return regionRefill(region, size);
+}
 
-  // Each bin is determined by powers of two, so double and incr. Limit to 4096
-  while (out < 7 && pow <= size) {
-    pow *= 2;
-    out++;
+/*
+* Frees every object of "region" at once, handing all its chunks but the
+* first back to the heap. Later chunks start as big as the last one was
+*/
+void my_region_reset(my_region *region)
+{
+  RegionChunk* chunk = region->chunks;
+  while (chunk != NULL) {
+    RegionChunk* next = chunk->next;
+    my_free(chunk);
+    chunk = next;
   }
+  region->chunks = NULL;
+  region->next = (char*) round_up((size_t) (region + 1), kAlignment);
+  region->end = region->firstEnd;
+}
 
-  return out;
+/*
+* Frees "region" and every object in it
+*/
+void my_region_destroy(my_region *region)
+{
+  if (region == NULL) {
+    return;
+  }
+  my_region_reset(region);
+  my_free(region);
 }
 
 /*
-* Given a size, allocates memory using mmap and returns starting address
+* Hands the calling thread's cached blocks back, then purges every arena's
+* dirty pages and empty slab runs right away. Returns 1 if any memory went
+* back to the OS
 */
-void *my_malloc(size_t size)
-{ 
-  // Checking is size is valid
-  if (size == 0 || size > kMaxAllocationSize) {
-    return NULL;
+int my_malloc_trim(void)
+{
+  ThreadCache* tc = getThreadCache();
+  drainCacheBins(tc);
+
+  bool released = false;
+  for (int i = 0; i < nArenas; i++) {
+    pthread_mutex_lock(&arenas[i].lock);
+    collectRemoteFrees(&arenas[i]);
+    released |= purgeDirty(&arenas[i], true);
+    released |= purgeEmptyRuns(&arenas[i]);
+    pthread_mutex_unlock(&arenas[i].lock);
   }
+  return released;
+}
 
-  // Aligning and providing minimum for size
-  size = round_up(size + kMetaBlockSize, kAlignment);
-  if (size < kPointerBlockSize) {
-    size = kPointerBlockSize;
+// Snapshot of every counter, summed over thread slots and arenas
+typedef struct StatsTotals {
+  size_t allocated;
+  size_t nmalloc;
+  size_t nfree;
+  size_t mapped;
+  size_t mappedBlock;
+  size_t mappedSlab;
+  size_t mappedHuge;
+  size_t retained;
+  size_t mmaps;
+  size_t munmaps;
+  size_t mremaps;
+  size_t splits;
+  size_t coalesces;
+  size_t searches;
+  size_t searchSteps;
+  size_t purged;
+  size_t binMalloc[N_STAT_BINS];
+  size_t binFree[N_STAT_BINS];
+  size_t binAllocated[N_STAT_BINS];
+} StatsTotals;
+
+// Names of the totals for my_mallctl and the JSON report
+static const struct {
+  const char* name;
+  size_t offset;
+} kStatNames[] = {
+  {"allocated", offsetof(StatsTotals, allocated)},
+  {"nmalloc", offsetof(StatsTotals, nmalloc)},
+  {"nfree", offsetof(StatsTotals, nfree)},
+  {"mapped", offsetof(StatsTotals, mapped)},
+  {"mapped_block", offsetof(StatsTotals, mappedBlock)},
+  {"mapped_slab", offsetof(StatsTotals, mappedSlab)},
+  {"mapped_huge", offsetof(StatsTotals, mappedHuge)},
+  {"retained", offsetof(StatsTotals, retained)},
+  {"mmaps", offsetof(StatsTotals, mmaps)},
+  {"munmaps", offsetof(StatsTotals, munmaps)},
+  {"mremaps", offsetof(StatsTotals, mremaps)},
+  {"splits", offsetof(StatsTotals, splits)},
+  {"coalesces", offsetof(StatsTotals, coalesces)},
+  {"searches", offsetof(StatsTotals, searches)},
+  {"search_steps", offsetof(StatsTotals, searchSteps)},
+  {"purged", offsetof(StatsTotals, purged)},
+};
+
+/*
+* Adds the counters of one thread slot into "totals"
+*/
+void addThreadStats(StatsTotals* totals, ThreadStats* stats) {
+  for (int i = 0; i < N_STAT_BINS; i++) {
+    BinStats* bin = &stats->bins[i];
+    totals->binMalloc[i] += atomic_load_explicit(&bin->nmalloc, memory_order_relaxed);
+    totals->binFree[i] += atomic_load_explicit(&bin->nfree, memory_order_relaxed);
+    // Frees counted by other threads make single slots wrap, sums don't
+    totals->binAllocated[i] += atomic_load_explicit(&bin->allocated, memory_order_relaxed) -
+                               atomic_load_explicit(&bin->freed, memory_order_relaxed);
   }
+}
 
-  int idx = getIndex(size);
+/*
+* Sums every counter into "totals" without taking any lock, so counts still
+* being updated may be a little behind
+*/
+void collectStats(StatsTotals* totals) {
+  memset(totals, 0, sizeof(*totals));
 
-  // If the relevant free list doesn't exist, initialise it. x2+ if idx=7
-  if (freeListArray[idx] == NULL) {
-    int multiple = size/ARENA_SIZE + 1;
-    freeListArray[idx] = initialise(multiple);
-    if (freeListArray[idx] == NULL) {
-      errno = ENOMEM;
-      exit(1);
-    }
+  addThreadStats(totals, &spareStats);
+  for (ThreadStats* stats = atomic_load_explicit(&allStats, memory_order_acquire);
+       stats != NULL; stats = stats->next) {
+    addThreadStats(totals, stats);
+  }
+  for (int i = 0; i < N_STAT_BINS; i++) {
+    totals->nmalloc += totals->binMalloc[i];
+    totals->nfree += totals->binFree[i];
+    totals->allocated += totals->binAllocated[i];
   }
 
-  MetaBlock* curr = freeListArray[idx];
+  totals->mappedBlock = atomic_load_explicit(&mappedBytes[BLOCK_CHUNK], memory_order_relaxed);
+  totals->mappedSlab = atomic_load_explicit(&mappedBytes[SLAB_CHUNK], memory_order_relaxed);
+  totals->mappedHuge = atomic_load_explicit(&mappedBytes[HUGE_CHUNK], memory_order_relaxed);
+  totals->mapped = totals->mappedBlock + totals->mappedSlab + totals->mappedHuge;
+  totals->retained = atomic_load_explicit(&retainedBytes, memory_order_relaxed);
+  totals->mmaps = atomic_load_explicit(&nMmaps, memory_order_relaxed);
+  totals->munmaps = atomic_load_explicit(&nMunmaps, memory_order_relaxed);
+  totals->mremaps = atomic_load_explicit(&nMremaps, memory_order_relaxed);
 
-  // Keep going to next until big enough block is found
-  while (curr != NULL && curr->size < size) {
-    PointerBlock* ptrs = getPointers(curr);
-    curr = ptrs->next;
+  for (int i = 0; i < nArenas; i++) {
+    ArenaStats* stats = &arenas[i].stats;
+    totals->splits += atomic_load_explicit(&stats->splits, memory_order_relaxed);
+    totals->coalesces += atomic_load_explicit(&stats->coalesces, memory_order_relaxed);
+    totals->searches += atomic_load_explicit(&stats->searches, memory_order_relaxed);
+    totals->searchSteps += atomic_load_explicit(&stats->searchSteps, memory_order_relaxed);
+    totals->purged += atomic_load_explicit(&stats->purged, memory_order_relaxed);
   }
+}
 
-  // Traversed list, nothing found
-  if (curr == NULL) {
-    // Request additional memory from OS if we have no room
-    int multiple = size/ARENA_SIZE + 1;
-    MetaBlock* toInsert = initialise(multiple);
+/*
+* Stores the counter called "name" in "value", the same names as the keys
+* of my_malloc_stats(). Returns 0, or ENOENT for an unknown name
+*/
+int my_mallctl(const char *name, size_t *value)
+{
+  for (size_t i = 0; i < sizeof(kStatNames) / sizeof(kStatNames[0]); i++) {
+    if (strcmp(name, kStatNames[i].name) == 0) {
+      StatsTotals totals;
+      collectStats(&totals);
+      *value = *(size_t*) (((char*) &totals) + kStatNames[i].offset);
+      return 0;
+    }
+  }
+  return ENOENT;
+}
+
+// Output buffer of my_malloc_stats, "len" keeps counting past its end
+typedef struct TextWriter {
+  char* buf;
+  size_t size;
+  size_t len;
+} TextWriter;
 
-    // Get pointer of current head a newly allocated blocks
-    PointerBlock* currentFreeListPtrs = getPointers(freeListArray[idx]);
-    PointerBlock* newlyAllocatedPtrs = getPointers(toInsert);
+/*
+* Appends formatted text to "writer", cut short if the buffer is full
+*/
+__attribute__((format(printf, 2, 3)))
+void appendText(TextWriter* writer, const char* format, ...) {
+  size_t room = writer->len < writer->size ? writer->size - writer->len : 0;
+  va_list args;
+  va_start(args, format);
+  int n = vsnprintf(room > 0 ? writer->buf + writer->len : NULL, room, format, args);
+  va_end(args);
+  if (n > 0) {
+    writer->len += n;
+  }
+}
 
-    // Map relationship, making newly mapped area new root
-    currentFreeListPtrs->prev = toInsert;
-    newlyAllocatedPtrs->next = freeListArray[idx];
+/*
+* Writes every counter to "buf" as a JSON object: the totals, then counters
+* per arena and per stats bin that was ever used. Like snprintf, at most
+* "size" bytes are written, NUL included, and the full length is returned.
+* Nothing is allocated, so it is safe from any context malloc is
+*/
+size_t my_malloc_stats(char *buf, size_t size)
+{
+  StatsTotals totals;
+  collectStats(&totals);
 
-    // Store in FreeList array and continue with my_malloc
-    freeListArray[idx] = toInsert;
-    curr = toInsert;
+  TextWriter writer = {buf, size, 0};
+  if (size > 0) {
+    buf[0] = '\0';
+  }
+  appendText(&writer, "{");
+  for (size_t i = 0; i < sizeof(kStatNames) / sizeof(kStatNames[0]); i++) {
+    appendText(&writer, "\"%s\":%zu,", kStatNames[i].name,
+                *(size_t*) (((char*) &totals) + kStatNames[i].offset));
   }
 
-  MetaBlock* secondBlock = NULL;
+  appendText(&writer, "\"arenas\":[");
+  for (int i = 0; i < nArenas; i++) {
+    ArenaStats* stats = &arenas[i].stats;
+    appendText(&writer, "%s{\"splits\":%zu,\"coalesces\":%zu,\"searches\":%zu,"
+                "\"search_steps\":%zu,\"purged\":%zu}", i > 0 ? "," : "",
+                atomic_load_explicit(&stats->splits, memory_order_relaxed),
+                atomic_load_explicit(&stats->coalesces, memory_order_relaxed),
+                atomic_load_explicit(&stats->searches, memory_order_relaxed),
+                atomic_load_explicit(&stats->searchSteps, memory_order_relaxed),
+                atomic_load_explicit(&stats->purged, memory_order_relaxed));
+  }
 
-  // If needed, the split block will become new root
-  if (curr->size >= size + kPointerBlockSize + kMinAllocationSize) {
-    secondBlock = splitBlock(curr, size);
+  // Bins are keyed by the smallest usable size they hold
+  appendText(&writer, "],\"bins\":[");
+  bool first = true;
+  for (int i = 0; i < N_STAT_BINS; i++) {
+    if (totals.binMalloc[i] == 0 && totals.binFree[i] == 0) {
+      continue;
+    }
+    const char* kind = i < N_SLAB_CLASSES ? "slab" : i < STAT_LARGE ? "block" :
+                       i == STAT_LARGE ? "large" : "huge";
+    size_t binSize = i < N_SLAB_CLASSES ? slabClassSize(i) :
+                     i < STAT_LARGE ? ((size_t) (i - N_SLAB_CLASSES) << kCacheBinShift) - kMetaBlockSize :
+                     i == STAT_LARGE ? ((size_t) N_CACHE_BINS << kCacheBinShift) - kMetaBlockSize :
+                     hugeThreshold;
+    appendText(&writer, "%s{\"kind\":\"%s\",\"size\":%zu,\"nmalloc\":%zu,\"nfree\":%zu,"
+                "\"allocated\":%zu}", first ? "" : ",", kind, binSize,
+                totals.binMalloc[i], totals.binFree[i], totals.binAllocated[i]);
+    first = false;
   }
+  appendText(&writer, "]}");
+  return writer.len;
+}
 
-  // Calculating new root and/or updating freelist pointers
-  if (curr == freeListArray[idx]) {
-    // If the first block in free list was deemed appropriate, we need new root
-    PointerBlock* currPointers = getPointers(curr);
-    MetaBlock* newRoot = currPointers->next;
-    PointerBlock* newRootPointers = getPointers(newRoot);
-    // If there is a split block, we can just make that the root
-    if (secondBlock != NULL) {
-      if (newRootPointers != NULL) {
-        newRootPointers->prev = secondBlock;
-      }
-      freeListArray[idx] = secondBlock;
-    } else {
-      // Otherwise we need to find another block
-      if (newRoot == NULL) {
-        // If there is no "next" element, then we need to make one
-        // If idx is 7, we need at least 2*4096 for any allocation otherwise, 1x
-        if (idx == 7) {
-          newRoot = initialise(2);
-        } else {
-          newRoot = initialise(1);
-        }
-      } else {
-        // Otherwise, simply point the next block's pointers to NULL
-        newRootPointers->prev = NULL;
-      }
-      // And in either case, that becomes the new root
-      freeListArray[idx] = newRoot;
+/*
+* Calls "fn" on every chunk of "arena", or of every arena if it is NULL, in
+* address order. Caller must hold the lock of every arena, so no chunk is
+* mapped or unmapped meanwhile
+*/
+void forEachChunk(Arena* arena, void (*fn)(Chunk*, void*), void* arg) {
+  for (size_t rootIdx = 0; rootIdx < (1ull << MAP_ROOT_BITS); rootIdx++) {
+    PageMapNode* node = atomic_load_explicit(&pageMap[rootIdx], memory_order_acquire);
+    if (node == NULL) {
+      continue;
     }
-  } else {
-    // In the case that the found block isnt the root, get the next and prev blocks
-    PointerBlock* currPointers = getPointers(curr);
-    MetaBlock* nextNode = currPointers->next;
-    MetaBlock* prevNode = currPointers->prev;
-
-    // Get the pointers of the next and prev blocks
-    PointerBlock* nextNodePointers = getPointers(nextNode);
-    PointerBlock* prevNodePointers = getPointers(prevNode);
-
-    // If block was split, we update pointers to point to this
-    if (secondBlock != NULL) {
-      if (nextNodePointers != NULL) {
-        nextNodePointers->prev = secondBlock;
+    for (size_t i = 0; i < (1ull << MAP_LEAF_BITS); i++) {
+      PageMapLeaf* leaf = atomic_load_explicit(&node->windows[i], memory_order_acquire);
+      if (leaf == NULL) {
+        continue;
       }
-      if (prevNodePointers != NULL) {
-        prevNodePointers->next = secondBlock;
-      }
-    } else {
-      // Otherwise, the next and prev now point to each other
-      if (nextNodePointers != NULL) {
-        nextNodePointers->prev = prevNode;
-      }
-      if (prevNodePointers != NULL) {
-        prevNodePointers->next = nextNode;
+      // A chunk spanning several windows is only visited from its first
+      Chunk* chunk = entryChunk(atomic_load_explicit(&leaf->pages[0], memory_order_relaxed));
+      size_t start = ((rootIdx << MAP_LEAF_BITS) | i) << CHUNK_SHIFT;
+      if (chunk != NULL && (size_t) chunk == start && (arena == NULL || chunk->arena == arena)) {
+        fn(chunk, arg);
       }
     }
   }
+}
 
-  // Set size, so we can go to right block properly
-  curr->size = size;
+/*
+* Calls "callback" on every block of "chunk", and on every object and free
+* range of its slab runs, with its payload, usable size and whether it is
+* in use. Caller must hold the lock of the chunk's arena
+*/
+void walkChunk(Chunk* chunk, my_heap_walk_fn callback, void* arg) {
+  if (chunk->kind == HUGE_CHUNK) {
+    MetaBlock* block = (MetaBlock*) (((size_t) chunk) + kChunkHeaderSize + chunk->lead) + 1;
+    callback(block + 1, blockUsable(block), 1, arg);
+    return;
+  }
 
-  // Set allocated bit on both header and footer boundary tags
-  MetaBlock* currRight = getRightMetaBlock(curr);
-  curr->size = size + 1;
-  currRight->size = size + 1;
+  if (chunk->kind == SLAB_CHUNK) {
+    // The arena's current slab chunk may not be carved into runs to the end
+    Arena* arena = chunk->arena;
+    size_t nRuns = chunk == arena->slabChunk ? arena->nextRun : ARENA_SIZE / kRunSize;
+    for (size_t r = 1; r < nRuns; r++) {
+      Run* run = (Run*) (((size_t) chunk) + r * kRunSize);
+      char* objects = ((char*) run) + kRunHeaderSize;
+      if (run->nFree == run->nObjects) {
+        callback(objects, kRunSize - kRunHeaderSize, 0, arg);
+        continue;
+      }
+      size_t objSize = slabClassSize(run->sizeClass);
+      for (int slot = 0; slot < run->nObjects; slot++) {
+        int used = !(run->bitmap[slot >> 6] & (1ull << (slot & 63)));
+        callback(objects + slot * objSize, objSize, used, arg);
+      }
+    }
+    if (nRuns < ARENA_SIZE / kRunSize) {
+      callback(((char*) chunk) + nRuns * kRunSize, ARENA_SIZE - nRuns * kRunSize, 0, arg);
+    }
+    return;
+  }
 
-  MetaBlock* out = (MetaBlock*) (((size_t) curr) + sizeof(MetaBlock));
+  // Boundary tags lead from the left fence post to the right one
+  MetaBlock* block = (MetaBlock*) (((size_t) chunk) + kChunkHeaderSize) + 1;
+  while (!(block->size & kFence)) {
+    size_t size = tagSize(block);
+    callback(block + 1, size - kMetaBlockSize, (block->size & kInUse) != 0, arg);
+    block = (MetaBlock*) (((size_t) block) + size);
+  }
+}
 
-  memset(out, 0, size - kMetaBlockSize);
+// Callback and argument of a my_heap_walk()
+typedef struct HeapWalk {
+  my_heap_walk_fn callback;
+  void* arg;
+} HeapWalk;
 
-  return out;
+static void walkChunkFn(Chunk* chunk, void* arg) {
+  HeapWalk* walk = arg;
+  walkChunk(chunk, walk->callback, walk->arg);
 }
 
 /*
-* Assumes pointer represents start of block, checks if allocation bit is set
+* Calls "callback" on every block and slab object of every arena, free or
+* in use, with "arg". Blocks held in thread caches or waiting to go back to
+* their arena count as in use. Every arena is locked throughout, so the
+* callback must not allocate or free
 */
-bool isAllocated(void* ptr) {
-  MetaBlock* toRemove = (MetaBlock*) (((size_t) ptr) - sizeof(MetaBlock));
-  return (toRemove->size % 2 == 1);
+void my_heap_walk(my_heap_walk_fn callback, void *arg)
+{
+  HeapWalk walk = {callback, arg};
+  lockAll();
+  forEachChunk(NULL, walkChunkFn, &walk);
+  unlockAll();
 }
 
+// Cells in a chunk's block map
+#define MAP_CELLS 64
+
+// Running totals of my_heap_report() for one arena, and the chunk at hand
+typedef struct ArenaReport {
+  TextWriter* writer;
+  size_t used;
+  size_t free;
+  // Free blocks of block chunks, the ones fragmentation is about
+  size_t freeBlocks;
+  size_t largestFree;
+  bool firstChunk;
+  size_t chunkStart;
+  size_t cellSize;
+  size_t cellUsed[MAP_CELLS];
+  size_t cellFree[MAP_CELLS];
+} ArenaReport;
+
 /*
-* Coalese Function, takes in address of Central MetaBlock, then 
-* checks left & right neighbours for combination
-* Updates the pointers a free-list as well if needed
+* Adds one block or object to the arena totals and its chunk's cells
 */
-void coalesce(MetaBlock* curr, int idx) {
-  // Obtaining start address of adjacent MetaBlocks
-  MetaBlock* leftNeighbour = (MetaBlock*) (((size_t) curr) - sizeof(MetaBlock));
-  MetaBlock* rightNeighbour = (MetaBlock*) (((size_t) curr) + curr->size);
+static void reportBlock(void* ptr, size_t size, int used, void* arg) {
+  ArenaReport* report = arg;
+  if (used) {
+    report->used += size;
+  } else {
+    report->free += size;
+    if (getChunk(ptr)->kind == BLOCK_CHUNK) {
+      report->freeBlocks += size;
+      if (size > report->largestFree) {
+        report->largestFree = size;
+      }
+    }
+  }
 
-  // Storing new root and size, may be unchanged
-  MetaBlock* root = curr;
-  size_t newSize = curr->size;
+  size_t start = ((size_t) ptr) - report->chunkStart;
+  size_t end = start + size;
+  for (size_t cell = start / report->cellSize; cell < MAP_CELLS && cell * report->cellSize < end; cell++) {
+    size_t from = cell * report->cellSize > start ? cell * report->cellSize : start;
+    size_t to = (cell + 1) * report->cellSize < end ? (cell + 1) * report->cellSize : end;
+    if (used) {
+      report->cellUsed[cell] += to - from;
+    } else {
+      report->cellFree[cell] += to - from;
+    }
+  }
+}
 
-  // Keeping track of pointers in case they need to be shuffled around
-  PointerBlock* leftPointers = NULL;
-  PointerBlock* rightPointers = NULL;
+/*
+* Walks one chunk into the report, writing its block map: one character per
+* 64th of the chunk, '#' all in use, '.' all free, '+' both, ' ' neither
+*/
+static void reportChunk(Chunk* chunk, void* arg) {
+  ArenaReport* report = arg;
+  report->chunkStart = (size_t) chunk;
+  report->cellSize = (chunk->size + MAP_CELLS - 1) / MAP_CELLS;
+  memset(report->cellUsed, 0, sizeof(report->cellUsed));
+  memset(report->cellFree, 0, sizeof(report->cellFree));
+  walkChunk(chunk, reportBlock, report);
 
-  // Checking if NOT fence post and unallocated
-  if (rightNeighbour->size < kMemorySize && !(rightNeighbour->size & 1)) {
-    newSize += rightNeighbour->size;
-    rightPointers = getPointers(rightNeighbour);
+  char map[MAP_CELLS + 1];
+  for (int i = 0; i < MAP_CELLS; i++) {
+    map[i] = report->cellUsed[i] == 0 ? (report->cellFree[i] == 0 ? ' ' : '.') :
+             report->cellFree[i] == 0 ? '#' : '+';
   }
+  map[MAP_CELLS] = '\0';
 
-  // Reassigning left root if left block is free
-  if (leftNeighbour->size < kMemorySize && !(leftNeighbour->size & 1)) {
-    newSize += leftNeighbour->size;
-    MetaBlock* leftNeighbourHeader = (MetaBlock*) (((size_t) leftNeighbour) - leftNeighbour->size + sizeof(MetaBlock));
-    leftPointers = getPointers(leftNeighbourHeader);
+  const char* kinds[] = {"block", "slab", "huge"};
+  appendText(report->writer, "%s{\"kind\":\"%s\",\"address\":\"%p\",\"size\":%zu,\"map\":\"%s\"}",
+             report->firstChunk ? "" : ",", kinds[chunk->kind], (void*) chunk, chunk->size, map);
+  report->firstChunk = false;
+}
 
-    root = leftNeighbourHeader;
+/*
+* Returns the smallest block size free list "idx" holds, see getIndex()
+*/
+size_t listMinSize(int idx) {
+  int fl = idx / SL_COUNT;
+  if (fl == 0) {
+    return (size_t) idx << 3;
   }
+  int bit = fl + FL_SHIFT - 1;
+  return ((size_t) 1 << bit) + ((size_t) (idx % SL_COUNT) << (bit - SL_LOG2));
+}
 
-  // Now handling the 4 cases we have in coalescing
-  root->size = newSize;
-  MetaBlock* coalescedRight = getRightMetaBlock(root);
-  coalescedRight->size = newSize;
-  
-  // If both left and right were allocated, insert block at the start of freelist
-  if ((!leftPointers && !rightPointers)) {
-    // Update pointers to match format of freelist root
-    PointerBlock* rootPointers = getPointers(root);
-    rootPointers->prev = NULL;
-    rootPointers->next = freeListArray[idx];
-
-    // Update freeList, so toRemove is now root
-    PointerBlock* freeListPointers = getPointers(freeListArray[idx]);
-    freeListPointers->prev = root;
-
-    freeListArray[idx] = root;
+/*
+* Counts the blocks of the large block tree rooted at "node", and their bytes
+*/
+void treeTally(MetaBlock* node, size_t* count, size_t* bytes) {
+  if (node == NULL) {
     return;
   }
+  (*count)++;
+  *bytes += node->size;
+  treeTally(getNode(node)->left, count, bytes);
+  treeTally(getNode(node)->right, count, bytes);
+}
 
-  // If left block ONLY was free, simply copy over its pointers to current block
-  if (leftPointers && !rightPointers) {
-    // Copy over pointers to root
-    PointerBlock* rootPointers = getPointers(root);
-    rootPointers->prev = leftPointers->prev;
-    rootPointers->next = leftPointers->next;
-
-    return;
+/*
+* Writes a report of how every arena's memory is laid out to "buf" as JSON:
+* per arena, the block map of each chunk, bytes in use and free, the
+* largest free block, external fragmentation (1 - largest free block / free
+* block bytes) and the length and bytes of each free list and of the large
+* block tree. Like snprintf, at most "size" bytes are written, NUL included,
+* and the full length is returned. Every arena is locked while it runs
+*/
+size_t my_heap_report(char *buf, size_t size)
+{
+  TextWriter writer = {buf, size, 0};
+  if (size > 0) {
+    buf[0] = '\0';
   }
 
-  // If right block ONLY was free, copy over pointers AND update adjacent pointers
-  if (!leftPointers && rightPointers) {
-    // Copy over pointes to root
-    PointerBlock* rootPointers = getPointers(root);
-    rootPointers->prev = rightPointers->prev;
-    rootPointers->next = rightPointers->next;
+  lockAll();
+  appendText(&writer, "{\"arenas\":[");
+  for (int i = 0; i < nArenas; i++) {
+    Arena* arena = &arenas[i];
+    ArenaReport report = {.writer = &writer, .firstChunk = true};
+    appendText(&writer, "%s{\"chunks\":[", i > 0 ? "," : "");
+    forEachChunk(arena, reportChunk, &report);
 
-    // Get the pointer blocks of next and prev in free list
-    PointerBlock* rightPrevPointers = getPointers(rightPointers->prev);
-    PointerBlock* rightNextPointers = getPointers(rightPointers->next);
+    double fragmentation = report.freeBlocks == 0 ? 0.0 :
+                           1.0 - (double) report.largestFree / report.freeBlocks;
+    appendText(&writer, "],\"used\":%zu,\"free\":%zu,\"free_blocks\":%zu,\"largest_free\":%zu,"
+               "\"fragmentation\":%.4f,\"lists\":[", report.used, report.free,
+               report.freeBlocks, report.largestFree, fragmentation);
 
-    // Make sure they point to the new root (which is more left) now
-    if (rightPrevPointers) {
-      rightPrevPointers->next = root;
+    // Only lists holding anything, keyed by the smallest block they take
+    bool first = true;
+    for (int idx = 0; idx < N_LISTS; idx++) {
+      size_t count = 0, bytes = 0;
+      for (MetaBlock* block = arena->freeListArray[idx]; block != NULL; block = getPointers(block)->next) {
+        count++;
+        bytes += block->size;
+      }
+      if (count > 0) {
+        appendText(&writer, "%s{\"size\":%zu,\"count\":%zu,\"bytes\":%zu}",
+                   first ? "" : ",", listMinSize(idx), count, bytes);
+        first = false;
+      }
     }
 
-    if (rightNextPointers) {
-      rightNextPointers->prev = root;
+    size_t count = 0, bytes = 0;
+    treeTally(arena->largeTree, &count, &bytes);
+    appendText(&writer, "],\"tree\":{\"size\":%zu,\"count\":%zu,\"bytes\":%zu}}",
+               kLargeBlockSize, count, bytes);
+  }
+  appendText(&writer, "]}");
+  unlockAll();
+  return writer.len;
+}
+
+/*
+* Writes the heap profile to "buf" like snprintf, in the text format of the
+* gperftools heap profiler that pprof reads: live and all sampled blocks
+* and their bytes, in total and per allocation stack, then the mappings
+* pprof resolves the stacks' addresses with. pprof scales the samples up
+* by the sampling interval
+*/
+size_t my_heap_profile(char *buf, size_t size)
+{
+  TextWriter writer = {buf, size, 0};
+  if (size > 0) {
+    buf[0] = '\0';
+  }
+
+  pthread_mutex_lock(&profLock);
+  size_t liveCount = 0, liveBytes = 0, allocCount = 0, allocBytes = 0;
+  for (int i = 0; i < nProfStacks; i++) {
+    liveCount += profStacks[i].liveCount;
+    liveBytes += profStacks[i].liveBytes;
+    allocCount += profStacks[i].allocCount;
+    allocBytes += profStacks[i].allocBytes;
+  }
+  appendText(&writer, "heap profile: %zu: %zu [%zu: %zu] @ heap_v2/%zu\n",
+             liveCount, liveBytes, allocCount, allocBytes, profInterval);
+  for (int i = 0; i < nProfStacks; i++) {
+    ProfStack* stack = &profStacks[i];
+    appendText(&writer, "%zu: %zu [%zu: %zu] @", stack->liveCount, stack->liveBytes,
+               stack->allocCount, stack->allocBytes);
+    for (int f = 0; f < stack->depth; f++) {
+      appendText(&writer, " 0x%zx", (size_t) stack->frames[f]);
     }
+    appendText(&writer, "\n");
+  }
+  pthread_mutex_unlock(&profLock);
 
-    // If this block was the freelist, we also need to update that
-    if (rightNeighbour == freeListArray[idx]) {
-      freeListArray[idx] = root;
+  appendText(&writer, "\nMAPPED_LIBRARIES:\n");
+  int fd = open("/proc/self/maps", O_RDONLY | O_CLOEXEC);
+  if (fd >= 0) {
+    char chunk[4096];
+    ssize_t n;
+    while ((n = read(fd, chunk, sizeof(chunk))) > 0) {
+      appendText(&writer, "%.*s", (int) n, chunk);
     }
+    close(fd);
+  }
+  return writer.len;
+}
 
+/*
+* Writes what "report" gives to the file the environment variable "name"
+* names, "-" for stderr. The buffer is mapped, so the report is of the heap
+* as the program left it
+*/
+static void writeReport(const char* name, size_t (*report)(char*, size_t)) {
+  const char* path = getenv(name);
+  if (path == NULL || nArenas == 0) {
     return;
   }
 
-  // Now in the case that both right and left blocks were free
-
-  // We decide to copy over left block pointers
-  PointerBlock* rootPointers = getPointers(root);
-  rootPointers->prev = leftPointers->prev;
-  rootPointers->next = leftPointers->next;
-
-  // Get pointers of right block
-  MetaBlock* rightPrev = rightPointers->prev;
-  MetaBlock* rightNext = rightPointers->next;
-
-  // We DELETE the right block from the Free-List, since we will already have it
-  if (rightPrev != NULL) {
-    PointerBlock* temp = getPointers(rightPrev);
-    temp->next = rightNext;
+  size_t len = report(NULL, 0);
+  size_t mapped = round_up(len + 1, kPageSize);
+  char* buf = mapPages(mapped);
+  if (buf == MAP_FAILED) {
+    return;
   }
-
-  if (rightNext) {
-    PointerBlock* temp2 = getPointers(rightNext);
-    temp2->prev = rightPrev;
+  // A chunk mapped in between would only make the report longer, cut it
+  len = report(buf, mapped);
+  if (len >= mapped) {
+    len = mapped - 1;
   }
+  buf[len++] = '\n';
 
-  // Again, if this deleted node was the root, we update the root
-  if (rightNeighbour == freeListArray[idx]) {
-      freeListArray[idx] = root;
+  int fd = strcmp(path, "-") == 0 ? STDERR_FILENO : open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd >= 0) {
+    writeAll(fd, buf, len);
+    if (fd != STDERR_FILENO) {
+      close(fd);
+    }
   }
-
+  unmapPages(buf, mapped);
 }
 
-
 /*
-* Checks if any allocations have actually been done, for free to continue
+* Writes the heap report to MYMALLOC_REPORT and the heap profile to
+* MYMALLOC_PROF as the process exits
 */
-bool isInitialised() {
-  for (int i = 0; i < 8; i++) {
-    if (freeListArray[i]) {
-      return true;
-    }
-  }
-  return false;
+__attribute__((destructor))
+static void dumpReports(void) {
+  writeReport("MYMALLOC_REPORT", my_heap_report);
+  writeReport("MYMALLOC_PROF", my_heap_profile);
 }
 
+#ifdef MYMALLOC_PRELOAD
+// Drop-in libc allocator for LD_PRELOAD. The build hides every other
+// symbol, so only these interpose. Zero byte requests get a unique pointer,
+// as from libc, since callers tend to take NULL for out of memory
+#define EXPORT __attribute__((visibility("default")))
 
-/*
-* Given a pointer, assumed to be start of allocated block, frees that block
-* and re-inserts it into the relevant free-list
-*/
-void my_free(void *ptr)
-{
-  if (ptr == NULL) {
-    return;
+EXPORT void* malloc(size_t size) {
+  return my_malloc(size == 0 ? 1 : size);
+}
+
+EXPORT void free(void* ptr) {
+  my_free(ptr);
+}
+
+EXPORT void* calloc(size_t nmemb, size_t size) {
+  if (nmemb == 0 || size == 0) {
+    return my_calloc(1, 1);
   }
-  // If pointer is NULL/allocated, or nothing has been allocated, throw error
-  if (!isInitialised() || !isAllocated(ptr)) {
-    errno = EINVAL;
-    fprintf(stderr, "my_free: %s\n", strerror(errno));
-    exit(1);
+  return my_calloc(nmemb, size);
+}
+
+EXPORT void* realloc(void* ptr, size_t size) {
+  // Without a pointer this is malloc, zero bytes included
+  if (ptr == NULL) {
+    return malloc(size);
   }
+  return my_realloc(ptr, size);
+}
 
-  // Block to be removed if criteria is met
-  MetaBlock* toRemove = (MetaBlock*) (((size_t) ptr) - sizeof(MetaBlock));
+EXPORT int posix_memalign(void** memptr, size_t alignment, size_t size) {
+  return my_posix_memalign(memptr, alignment, size == 0 ? 1 : size);
+}
+
+EXPORT void* aligned_alloc(size_t alignment, size_t size) {
+  return my_aligned_alloc(alignment, size == 0 ? 1 : size);
+}
 
-  // Clear out last bit to properly get index and right block
-  toRemove->size = toRemove->size - 1;
+EXPORT void* memalign(size_t alignment, size_t size) {
+  return my_memalign(alignment, size == 0 ? 1 : size);
+}
 
-  // Get index of freeList and Right Block, update right block to be unallocated
-  int idx = getIndex(toRemove->size);
-  MetaBlock* toRemoveRight = getRightMetaBlock(toRemove);
-  toRemoveRight->size = toRemoveRight->size - 1;
+EXPORT void* valloc(size_t size) {
+  return my_memalign(kPageSize, size == 0 ? 1 : size);
+}
 
-  // Coalesce, updating new root among 3 coninuous blocks
-  coalesce(toRemove, idx);
-}
\ No newline at end of file
+EXPORT size_t malloc_usable_size(void* ptr) {
+  return my_malloc_usable_size(ptr);
+}
+#endif
@@ -2,6 +2,7 @@
 #define MYMALLOC_HEADER
 
 #include <stddef.h>
+#include <stdint.h>
 
 #define USE(...)             \
     do                       \
@@ -9,24 +10,101 @@
         (void)(__VA_ARGS__); \
     } while (0)
 
-#ifdef ENABLE_LOG
-#define LOG(...) fprintf(stderr, "[malloc] " __VA_ARGS__);
-#else
-#define LOG(...)
-#endif
-
-#define N_LISTS 59
+// Number of segregated free lists in each arena: 7 powers of two of 8
+// steps each for blocks below 4 KB. Larger free blocks are kept in a
+// best-fit tree instead
+#define N_LISTS 56
 
 // Word alignment
 const size_t kAlignment = sizeof(size_t);
 // Minimum allocation size (1 word)
 const size_t kMinAllocationSize = kAlignment;
-// Maximum allocation size (16 MB)
+// Maximum allocation size, huge blocks are in practice limited by the OS
 extern const size_t kMaxAllocationSize;
 // Arena size is 4 MB
 const size_t ARENA_SIZE = (4ull << 20);
 
 void *my_malloc(size_t size);
+void *my_calloc(size_t nmemb, size_t size);
+void *my_realloc(void *ptr, size_t size);
+void *my_memalign(size_t alignment, size_t size);
+void *my_aligned_alloc(size_t alignment, size_t size);
+int my_posix_memalign(void **memptr, size_t alignment, size_t size);
 void my_free(void *p);
+void my_free_sized(void *p, size_t size);
+size_t my_malloc_usable_size(void *p);
+void *my_malloc_at_least(size_t size, size_t *actual);
+size_t my_malloc_batch(size_t size, size_t n, void **out);
+void my_free_batch(void **ptrs, size_t n);
+int my_malloc_trim(void);
+
+// Regions: objects with a common lifetime, bump allocated without headers
+// from chunks of the heap, then freed all at once by my_region_reset() or
+// my_region_destroy(). A region must not be used by two threads at a time
+typedef struct my_region my_region;
+my_region *my_region_create(void);
+void *my_region_alloc(my_region *region, size_t size);
+void my_region_reset(my_region *region);
+void my_region_destroy(my_region *region);
+
+// Runtime statistics: my_malloc_stats() writes every counter as JSON into
+// "buf" like snprintf, my_mallctl() reads one by name
+size_t my_malloc_stats(char *buf, size_t size);
+int my_mallctl(const char *name, size_t *value);
+
+// Heap inspection: my_heap_walk() calls "callback" on every block and slab
+// object with its payload, usable size and whether it is in use, and
+// my_heap_report() writes each arena's layout and fragmentation as JSON
+typedef void (*my_heap_walk_fn)(void *ptr, size_t size, int used, void *arg);
+void my_heap_walk(my_heap_walk_fn callback, void *arg);
+size_t my_heap_report(char *buf, size_t size);
+
+// Heap profiling: with MYMALLOC_PROF_SAMPLE=<bytes>, about one allocation
+// in that many bytes has its stack recorded until it is freed.
+// my_heap_profile() writes the sampled live and total allocations per stack
+// in pprof's heap profile format
+size_t my_heap_profile(char *buf, size_t size);
+
+// Allocation tracing: with MYMALLOC_TRACE naming a file, "%p" in it standing
+// for the process id, every call is appended to it as a my_trace_record
+// after a my_trace_header. bench/replay runs a trace against any build
+#define MY_TRACE_MAGIC "MYMTRACE"
+#define MY_TRACE_VERSION 1
+
+enum my_trace_op
+{
+    MY_TRACE_MALLOC,
+    MY_TRACE_CALLOC,
+    MY_TRACE_MEMALIGN,
+    // A realloc is the block it was given, then the block it returned, NULL
+    // if it failed
+    MY_TRACE_REALLOC_FROM,
+    MY_TRACE_REALLOC,
+    MY_TRACE_FREE,
+};
+
+typedef struct my_trace_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+} my_trace_header;
+
+typedef struct my_trace_record
+{
+    // Order of the call among those of every thread. Frees take theirs
+    // before the block is released, allocations after they got one
+    uint64_t seq;
+    // Nanoseconds since tracing started
+    uint64_t time;
+    // Block allocated or freed
+    uint64_t ptr;
+    // Bytes asked for, or given to my_free_sized, 0 for my_free
+    uint64_t size;
+    uint32_t thread;
+    uint16_t op;
+    // log2 of the alignment asked of my_memalign
+    uint16_t align;
+} my_trace_record;
 
 #endif
@@ -29,7 +29,6 @@ class SubprocessExit(Enum):
 def setup_parser(parser: ArgumentParser()):
     parser.add_argument("-t", "--test", help="test name to run", type=str)
     parser.add_argument("--release", help="build in release mode", action="store_true")
-    parser.add_argument("--log", help="build with logging", action="store_true")
     parser.add_argument("-m", "--malloc", type=str, help="allocator name, default to \"mymalloc\"")
 
 
@@ -154,8 +153,6 @@ def main():
     build_cmd = f"MALLOC={args.malloc} " if args.malloc is not None else ""
     if args.release:
         build_cmd += "RELEASE=1 "
-    if args.log:
-        build_cmd += "LOG=1 "
 
     output, exit_code = make(build_cmd, script_path)
     check_make(build_cmd, output, exit_code)
@@ -0,0 +1,42 @@
+#include "testing.h"
+#include <pthread.h>
+#include <string.h>
+
+#define NTHREADS 4
+#define NALLOCS 2000
+
+static void *ptrs[NTHREADS][NALLOCS];
+
+// Frees blocks allocated by the main thread, then allocates some for the
+// main thread to free, so every block crosses arenas both ways
+static void *worker(void *arg)
+{
+    void **mine = arg;
+    for (int i = 0; i < NALLOCS; i++)
+    {
+        freeing(mine[i]);
+        mine[i] = mallocing(1 + (i * 53) % 5000);
+        memset(mine[i], 0xab, 1 + (i * 53) % 5000);
+    }
+    return NULL;
+}
+
+int main()
+{
+    // Force more arenas than this machine may have cores
+    setenv("MYMALLOC_ARENAS", "4", 1);
+
+    for (int t = 0; t < NTHREADS; t++)
+        for (int i = 0; i < NALLOCS; i++)
+            ptrs[t][i] = mallocing(1 + (i * 31) % 5000);
+
+    pthread_t threads[NTHREADS];
+    for (int t = 0; t < NTHREADS; t++)
+        pthread_create(&threads[t], NULL, worker, ptrs[t]);
+    for (int t = 0; t < NTHREADS; t++)
+        pthread_join(threads[t], NULL);
+
+    for (int t = 0; t < NTHREADS; t++)
+        freeing_loop(ptrs[t], NALLOCS);
+    return 0;
+}
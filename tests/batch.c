@@ -0,0 +1,45 @@
+#include "testing.h"
+#include <string.h>
+
+#define NALLOCS 500
+
+int main()
+{
+    static void *ptrs[NALLOCS];
+    static size_t sizes[] = {1, 8, 100, 256, 300, 1000, 4000, 100000, 2 << 20};
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        size_t size = sizes[s];
+        size_t n = size > (1 << 20) ? 8 : NALLOCS;
+        assert(my_malloc_batch(size, n, ptrs) == n);
+        for (size_t i = 0; i < n; i++)
+        {
+            CHECK_NULL(ptrs[i]);
+            memset(ptrs[i], (int)i, size);
+        }
+        for (size_t i = 0; i < n; i++)
+        {
+            unsigned char *p = ptrs[i];
+            assert(p[0] == (unsigned char)i && p[size - 1] == (unsigned char)i);
+        }
+
+        // Batch frees mix in NULLs and single frees of the same objects
+        for (size_t i = 0; i < n; i += 7)
+        {
+            freeing(ptrs[i]);
+            ptrs[i] = NULL;
+        }
+        my_free_batch(ptrs, n);
+    }
+
+    // Huge and block pointers of the same arena mix in one batch
+    void *mixed[] = {mallocing(2000), mallocing(2 << 20), mallocing(2000)};
+    my_free_batch(mixed, 3);
+
+    // Everything freed in a batch is reused
+    assert(my_malloc_batch(1000, NALLOCS, ptrs) == NALLOCS);
+    for (size_t i = 0; i < NALLOCS; i++)
+        memset(ptrs[i], 1, 1000);
+    my_free_batch(ptrs, NALLOCS);
+    return 0;
+}
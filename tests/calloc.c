@@ -0,0 +1,44 @@
+#include "testing.h"
+#include <stdint.h>
+#include <string.h>
+
+static void check_zero(unsigned char *p, size_t size)
+{
+    for (size_t k = 0; k < size; k++)
+        assert(p[k] == 0);
+}
+
+int main()
+{
+    // Dirty every size, free it, then the same sizes must come back zeroed
+    for (size_t size = 1; size <= 5000; size += 7)
+    {
+        unsigned char *p = mallocing(size);
+        memset(p, 0xff, size);
+        freeing(p);
+        unsigned char *q = my_calloc(1, size);
+        CHECK_NULL(q);
+        check_zero(q, size);
+        memset(q, 0xff, size);
+        freeing(q);
+    }
+
+    // Large blocks, both fresh from the OS and reused after being dirtied
+    void *ptrs[8];
+    for (int round = 0; round < 2; round++)
+    {
+        for (int i = 0; i < 8; i++)
+        {
+            size_t size = (64 << 10) * (i + 1);
+            ptrs[i] = my_calloc(size / 8, 8);
+            CHECK_NULL(ptrs[i]);
+            check_zero(ptrs[i], size);
+            memset(ptrs[i], 0xab, size);
+        }
+        freeing_loop(ptrs, 8);
+    }
+
+    // Overflowing element counts fail instead of wrapping
+    assert(my_calloc(SIZE_MAX / 2, 4) == NULL);
+    return 0;
+}
@@ -0,0 +1,108 @@
+#include "testing.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Frees a "size" byte object, then another, then the first again in a
+// child, alone or in a batch with a live neighbour, which must be turned
+// away with an error exit
+static void rejects_double_free(size_t size, bool batch)
+{
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if (pid == 0)
+    {
+        freopen("/dev/null", "w", stderr);
+        void *ptr = mallocing(size);
+        void *other = mallocing(size);
+        freeing(ptr);
+        if (batch)
+        {
+            void *ptrs[] = {ptr, other};
+            my_free_batch(ptrs, 2);
+            _exit(0);
+        }
+        freeing(other);
+        freeing(ptr);
+        _exit(0);
+    }
+    int status;
+    assert(waitpid(pid, &status, 0) == pid);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 1);
+}
+
+// Frees the object at "arg" twice from a thread of another arena
+static void *free_twice(void *arg)
+{
+    freeing(arg);
+    freeing(arg);
+    return NULL;
+}
+
+// Allocates a "size" byte object in a child, then has a second thread, on
+// another arena, free it twice. The second free must be turned away while
+// the object waits on its owner's remote free list
+static void rejects_remote_double_free(size_t size)
+{
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if (pid == 0)
+    {
+        freopen("/dev/null", "w", stderr);
+        void *ptr = mallocing(size);
+        pthread_t thread;
+        pthread_create(&thread, NULL, free_twice, ptr);
+        pthread_join(thread, NULL);
+        _exit(0);
+    }
+    int status;
+    assert(waitpid(pid, &status, 0) == pid);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 1);
+}
+
+int main()
+{
+    // More arenas than cores are handed out round-robin, so every new
+    // thread gets an arena of its own
+    char arenas[16];
+    snprintf(arenas, sizeof(arenas), "%ld", sysconf(_SC_NPROCESSORS_ONLN) + 1);
+    setenv("MYMALLOC_ARENAS", arenas, 1);
+
+    // Blocks are caught freed twice while the thread cache holds them, as
+    // well as once they are back in the free lists
+    size_t sizes[] = {300, 500, 1000, 2000};
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+        rejects_double_free(sizes[i], false);
+        rejects_double_free(sizes[i], true);
+    }
+
+    // So are slab objects with room for a second word, which the cache
+    // marks, before their run's bitmap knows they are free
+    for (size_t size = 16; size <= 256; size += 40)
+    {
+        rejects_double_free(size, false);
+        rejects_double_free(size, true);
+    }
+
+    // Slab objects and blocks freed by a thread of another arena are marked
+    // before they are pushed onto their owner's list
+    size_t remote[] = {16, 200, 500, 100000};
+    for (size_t i = 0; i < sizeof(remote) / sizeof(remote[0]); i++)
+        rejects_remote_double_free(remote[i]);
+
+    // An object handed out again from the cache may be freed again
+    size_t reused[] = {24, 500};
+    for (size_t i = 0; i < sizeof(reused) / sizeof(reused[0]); i++)
+    {
+        void *ptr = mallocing(reused[i]);
+        freeing(ptr);
+        void *again = mallocing(reused[i]);
+        assert(again == ptr);
+        freeing(again);
+    }
+    return 0;
+}
@@ -2,5 +2,9 @@
 
 int main()
 {
-    mallocing(kMaxAllocationSize);
+    // Past the old 16 MB cap, served by a mapping of its own
+    char *ptr = mallocing(64ull << 20);
+    ptr[0] = 1;
+    ptr[(64ull << 20) - 1] = 1;
+    freeing(ptr);
 }
@@ -0,0 +1,39 @@
+#include "testing.h"
+#include <string.h>
+
+#define HUGE (32ull << 20)
+
+int main()
+{
+    // Freeing a huge block hands its memory straight back to the kernel
+    size_t before = resident_bytes();
+    char *ptr = mallocing(HUGE);
+    memset(ptr, 1, HUGE);
+    assert(resident_bytes() >= before + HUGE);
+    freeing(ptr);
+    assert(resident_bytes() < before + HUGE / 2);
+
+    // Growing and shrinking huge blocks keeps their contents
+    ptr = mallocing(HUGE);
+    for (size_t k = 0; k < HUGE; k += 4096)
+        ptr[k] = (char)(k >> 12);
+    ptr = my_realloc(ptr, 3 * HUGE);
+    CHECK_NULL(ptr);
+    for (size_t k = 0; k < HUGE; k += 4096)
+        assert(ptr[k] == (char)(k >> 12));
+    ptr = my_realloc(ptr, HUGE / 2);
+    CHECK_NULL(ptr);
+    for (size_t k = 0; k < HUGE / 2; k += 4096)
+        assert(ptr[k] == (char)(k >> 12));
+
+    // Below the threshold it moves back into an arena
+    ptr = my_realloc(ptr, 4096);
+    CHECK_NULL(ptr);
+    for (size_t k = 0; k < 4096; k += 4096)
+        assert(ptr[k] == (char)(k >> 12));
+    freeing(ptr);
+
+    // Sizes no mapping can hold fail instead of exiting
+    assert(my_malloc(kMaxAllocationSize) == NULL);
+    return 0;
+}
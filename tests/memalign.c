@@ -0,0 +1,62 @@
+#include "testing.h"
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#define NALLOCS 64
+
+static bool is_aligned(void *ptr, size_t alignment)
+{
+    return ((uintptr_t)ptr & (alignment - 1)) == 0;
+}
+
+int main()
+{
+    // Every alignment and a spread of sizes, filled to catch overlaps
+    static void *ptrs[NALLOCS];
+    static size_t sizes[] = {1, 24, 100, 256, 1000, 5000, 70000};
+    for (size_t alignment = 16; alignment <= (1 << 20); alignment <<= 1)
+    {
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+        {
+            for (int i = 0; i < NALLOCS; i++)
+            {
+                ptrs[i] = my_memalign(alignment, sizes[s]);
+                CHECK_NULL(ptrs[i]);
+                assert(is_aligned(ptrs[i], alignment));
+                memset(ptrs[i], i, sizes[s]);
+            }
+            for (int i = 0; i < NALLOCS; i++)
+            {
+                unsigned char *p = ptrs[i];
+                assert(p[0] == i && p[sizes[s] - 1] == i);
+            }
+            freeing_loop(ptrs, NALLOCS);
+        }
+    }
+
+    // The leading slack goes back to the free lists, so aligned blocks pack
+    char *a = my_aligned_alloc(64, 1000);
+    char *b = my_aligned_alloc(64, 1000);
+    CHECK_NULL(a);
+    CHECK_NULL(b);
+    size_t distance = b > a ? (size_t)(b - a) : (size_t)(a - b);
+    assert(distance < 1000 + 2 * 64 + 32);
+    freeing(a);
+    freeing(b);
+
+    // Huge blocks take their alignment from the chunk's lead
+    void *huge = NULL;
+    assert(my_posix_memalign(&huge, 1 << 23, 8 << 20) == 0);
+    assert(is_aligned(huge, 1 << 23));
+    memset(huge, 1, 8 << 20);
+    freeing(huge);
+
+    // Bad alignments are rejected
+    void *ptr = NULL;
+    assert(my_posix_memalign(&ptr, 12, 100) == EINVAL);
+    assert(my_posix_memalign(&ptr, 4, 100) == EINVAL);
+    assert(my_memalign(48, 100) == NULL && errno == EINVAL);
+    return 0;
+}
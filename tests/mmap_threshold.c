@@ -0,0 +1,42 @@
+#include "testing.h"
+#include <string.h>
+
+#define SMALL 300000
+#define LARGE (80 << 20)
+
+static void *first;
+static size_t merged;
+
+static void findMerged(void *ptr, size_t size, int used, void *arg)
+{
+    USE(arg);
+    if (ptr == first)
+        merged = used ? 0 : size;
+}
+
+int main()
+{
+    // Requests up to a gigabyte are served from the arena's chunks
+    setenv("MYMALLOC_ARENAS", "1", 1);
+    setenv("MYMALLOC_MMAP_THRESHOLD", "1000000000", 1);
+
+    // A block that large gets a chunk of its own, the next one follows it
+    first = mallocing(SMALL + LARGE);
+    char *last = mallocing(SMALL);
+    assert(last > (char *)first && last - (char *)first < 2 * LARGE);
+    memset(first, 1, SMALL + LARGE);
+
+    // Shrunk in place, it leaves a free block on its right larger than any
+    // fence post tag, which it merges with when freed
+    assert(my_realloc(first, SMALL) == first);
+    freeing(first);
+    my_heap_walk(findMerged, NULL);
+    assert(merged >= SMALL + LARGE);
+
+    // And is handed out whole again
+    char *large = mallocing(SMALL + LARGE);
+    assert(large == first);
+    freeing(large);
+    freeing(last);
+    return 0;
+}
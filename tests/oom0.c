@@ -1,3 +1,4 @@
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/resource.h>
@@ -5,6 +6,28 @@
 #include "../mymalloc.h"
 #include "testing.h"
 
+// Allocates "size" byte objects until memory runs out, linked through their
+// first word, then frees them all. Running out fails with ENOMEM, the
+// process goes on
+static void exhaust(size_t size) {
+  void *head = NULL;
+  void *ptr;
+  size_t n = 0;
+  errno = 0;
+  while ((ptr = my_malloc(size)) != NULL) {
+    *(void **) ptr = head;
+    head = ptr;
+    n++;
+  }
+  assert(errno == ENOMEM && n > 0);
+
+  while (head != NULL) {
+    void *next = *(void **) head;
+    my_free(head);
+    head = next;
+  }
+}
+
 int main() {
   set_mem_limit((16ull << 20) << 3 /* bytes */);
 
@@ -19,5 +42,15 @@ int main() {
 
   my_free(ptr);
 
+  // Blocks from the free lists, cached blocks and slab runs each need new
+  // chunks once the memory limit is reached. Slab chunks are kept once
+  // mapped, so they go last
+  exhaust(100000);
+  exhaust(1000);
+  exhaust(64);
+  ptr = my_malloc(sizeof(int *));
+  CHECK_NULL(ptr);
+  my_free(ptr);
+
   return EXIT_SUCCESS;
 }
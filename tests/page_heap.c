@@ -0,0 +1,48 @@
+#include "testing.h"
+#include <string.h>
+
+#define NALLOCS 64
+#define SIZE (512 << 10)
+
+static void *ptrs[NALLOCS];
+
+static void burst(void)
+{
+    for (int i = 0; i < NALLOCS; i++)
+    {
+        ptrs[i] = mallocing(SIZE);
+        memset(ptrs[i], i, SIZE);
+    }
+}
+
+int main()
+{
+    freeing(mallocing(SIZE));
+
+    // Chunks for a growing heap come from reservations that double in size,
+    // so far fewer mmap calls than chunks
+    size_t mmaps = counter("mmaps");
+    size_t mapped = counter("mapped_block");
+    burst();
+    size_t chunks = (counter("mapped_block") - mapped) / ARENA_SIZE;
+    assert(chunks >= 8);
+    assert(counter("mmaps") - mmaps <= chunks / 2);
+
+    // Emptied chunks go back to the page heap, purged, not to the OS
+    size_t munmaps = counter("munmaps");
+    freeing_loop(ptrs, NALLOCS);
+    assert(counter("munmaps") == munmaps);
+    assert(counter("retained") >= (chunks - 1) * ARENA_SIZE);
+
+    // And the next burst takes them again, zeroed, without mapping anything
+    mmaps = counter("mmaps");
+    for (int i = 0; i < NALLOCS; i++)
+    {
+        ptrs[i] = my_calloc(1, SIZE);
+        CHECK_NULL(ptrs[i]);
+        assert(((char *)ptrs[i])[SIZE - 1] == 0);
+    }
+    assert(counter("mmaps") == mmaps);
+    freeing_loop(ptrs, NALLOCS);
+    return 0;
+}
@@ -0,0 +1,59 @@
+#include "testing.h"
+#include <stdint.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define SMALL 24
+#define BLOCK 2000
+#define HUGE_SIZE (16 << 20)
+
+// Frees "ptr" in a child, which must be turned away with an error exit
+static void rejects(void *ptr)
+{
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if (pid == 0)
+    {
+        freopen("/dev/null", "w", stderr);
+        my_free(ptr);
+        _exit(0);
+    }
+    int status;
+    assert(waitpid(pid, &status, 0) == pid);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 1);
+}
+
+int main()
+{
+    char *small = mallocing(SMALL);
+    char *block = mallocing(BLOCK);
+    char *huge = mallocing(HUGE_SIZE);
+
+    // Sizes come from the page map, no header is read for slab objects
+    assert(my_malloc_usable_size(small) == SMALL);
+    assert(my_malloc_usable_size(block) >= BLOCK);
+    assert(my_malloc_usable_size(huge) >= HUGE_SIZE);
+
+    // Pages of no chunk, or of a slab chunk's header, or past a huge
+    // chunk's payload have nothing to free
+    int local;
+    rejects(&local);
+    rejects((void *)~(uintptr_t)4095);
+    rejects((void *)(((uintptr_t)small & ~(uintptr_t)(ARENA_SIZE - 1)) + 256));
+    rejects(huge + HUGE_SIZE / 2);
+
+    // Nor does a pointer into the middle of an object
+    rejects(small + 1);
+    rejects(small + SMALL / 2);
+    rejects(huge + 64);
+
+    // A payload word taken for a header describes no block of the chunk
+    memset(block, 1, BLOCK);
+    rejects(block + 64);
+
+    freeing(small);
+    freeing(block);
+    freeing(huge);
+    return 0;
+}
@@ -0,0 +1,64 @@
+#include "testing.h"
+#include <malloc.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#define PRELOAD "out/libmymalloc_preload.so"
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        // Run again with the drop-in library ahead of libc
+        setenv("LD_PRELOAD", PRELOAD, 1);
+        execl(argv[0], argv[0], "preloaded", (char *)NULL);
+        abort();
+    }
+
+    // One byte is an 8 byte slab object here, libc would give 24
+    char *small = malloc(1);
+    assert(small != NULL && malloc_usable_size(small) == 8);
+    free(small);
+
+    // Anything as big as 16 bytes is 16 byte aligned, as callers of libc's
+    // malloc may take for granted: slab objects, blocks and huge chunks
+    static char *live[2048];
+    size_t nlive = 0;
+    for (size_t size = 1; size < 70000; size += size < 1024 ? 1 : 997)
+    {
+        char *ptr = malloc(size);
+        assert(ptr != NULL);
+        assert(((uintptr_t)ptr & (size < 16 ? 7 : 15)) == 0);
+        assert(malloc_usable_size(ptr) >= size);
+        memset(ptr, 1, size);
+        live[nlive++] = ptr;
+    }
+    while (nlive > 0)
+        free(live[--nlive]);
+    void *huge = malloc(64 << 20);
+    assert(huge != NULL && ((uintptr_t)huge & 15) == 0);
+    free(huge);
+
+    // The rest of the family, zero sizes included
+    assert(malloc(0) != NULL);
+    int *zeroed = calloc(1000, sizeof(int));
+    for (int i = 0; i < 1000; i++)
+        assert(zeroed[i] == 0);
+    zeroed = realloc(zeroed, 100000 * sizeof(int));
+    assert(zeroed != NULL && zeroed[999] == 0);
+    free(zeroed);
+    void *aligned = NULL;
+    assert(posix_memalign(&aligned, 64, 100) == 0 && ((size_t)aligned & 63) == 0);
+    free(aligned);
+    assert(((size_t)aligned_alloc(4096, 4096) & 4095) == 0);
+    assert(((size_t)memalign(256, 10) & 255) == 0);
+    assert(((size_t)valloc(10) & 4095) == 0);
+
+    // Unmodified programs, through stdio and a forking shell, still run
+    char *line = strdup("preloaded");
+    printf("%s\n", line);
+    free(line);
+    assert(system("echo 3 1 2 | tr ' ' '\\n' | sort -n | tr -d '\\n' | grep -q 123") == 0);
+    return 0;
+}
@@ -0,0 +1,83 @@
+#include "testing.h"
+#include <stdint.h>
+#include <string.h>
+
+#define NALLOCS 2000
+#define SIZE 1000
+#define INTERVAL 4096
+#define HUGE (8 << 20)
+
+static void *ptrs[NALLOCS];
+static char buf[1 << 20];
+
+// The allocation site every sample should be found at
+__attribute__((noinline)) static void *site(size_t size)
+{
+    void *ptr = mallocing(size);
+    __asm__ volatile("" ::: "memory");
+    return ptr;
+}
+
+static void header(size_t counts[4])
+{
+    size_t len = my_heap_profile(buf, sizeof(buf));
+    assert(len < sizeof(buf) && len == strlen(buf));
+    char period[32];
+    assert(sscanf(buf, "heap profile: %zu: %zu [%zu: %zu] @ heap_v2/%31s", &counts[0], &counts[1],
+                  &counts[2], &counts[3], period) == 5);
+    assert(strcmp(period, "4096") == 0);
+    assert(strstr(buf, "\nMAPPED_LIBRARIES:\n") != NULL);
+}
+
+int main()
+{
+    setenv("MYMALLOC_PROF_SAMPLE", "4096", 1);
+    for (int i = 0; i < NALLOCS; i++)
+        ptrs[i] = site(SIZE);
+
+    // About one sample per interval, every one of the site's size
+    size_t counts[4];
+    header(counts);
+    size_t expect = NALLOCS * SIZE / INTERVAL;
+    assert(counts[0] > expect / 2 && counts[0] < expect * 2);
+    assert(counts[1] == counts[0] * SIZE && counts[2] >= counts[0]);
+
+    // The stack holding every sample runs through the site
+    uintptr_t start = (uintptr_t)site;
+    int found = 0;
+    for (char *line = strchr(buf, '\n') + 1; *line != '\n'; line = strchr(line, '\n') + 1)
+    {
+        size_t live;
+        assert(sscanf(line, "%zu:", &live) == 1);
+        if (live != counts[0])
+            continue;
+        for (char *at = strstr(line, " 0x"); at != NULL && at < strchr(line, '\n'); at = strstr(at + 1, " 0x"))
+        {
+            uintptr_t frame = strtoull(at + 1, NULL, 16);
+            found |= frame > start && frame < start + 256;
+        }
+    }
+    assert(found);
+
+    // Freed samples leave the live counts, not the totals, however freed
+    my_free_batch(ptrs, NALLOCS / 2);
+    for (int i = NALLOCS / 2; i < NALLOCS; i++)
+        freeing(ptrs[i]);
+    size_t after[4];
+    header(after);
+    assert(after[0] == 0 && after[1] == 0);
+    assert(after[2] == counts[2] && after[3] == counts[3]);
+
+    // A huge block, always sampled, stays live when resized in place, at its
+    // new size
+    char *huge = mallocing(HUGE);
+    header(counts);
+    assert(counts[0] == 1 && counts[1] == HUGE);
+    assert(my_realloc(huge, HUGE / 2) == huge);
+    header(counts);
+    assert(counts[0] == 1 && counts[1] == HUGE / 2);
+    freeing(huge);
+    header(counts);
+    assert(counts[0] == 0 && counts[1] == 0);
+    return 0;
+}
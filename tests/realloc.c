@@ -0,0 +1,56 @@
+#include "testing.h"
+#include <string.h>
+
+static void fill(unsigned char *p, size_t size)
+{
+    for (size_t k = 0; k < size; k++)
+        p[k] = (unsigned char)(k * 7);
+}
+
+static void check(unsigned char *p, size_t size)
+{
+    for (size_t k = 0; k < size; k++)
+        assert(p[k] == (unsigned char)(k * 7));
+}
+
+int main()
+{
+    // A growing vector keeps its contents through every size
+    size_t size = 1;
+    unsigned char *v = my_realloc(NULL, size);
+    CHECK_NULL(v);
+    fill(v, size);
+    while (size < (8 << 20))
+    {
+        v = my_realloc(v, size * 2);
+        CHECK_NULL(v);
+        check(v, size);
+        size *= 2;
+        fill(v, size);
+    }
+
+    // And shrinking keeps the front
+    v = my_realloc(v, 100);
+    CHECK_NULL(v);
+    check(v, 100);
+    freeing(v);
+
+    // Shrinking a block happens in place
+    unsigned char *a = mallocing(4096);
+    fill(a, 4096);
+    assert(my_realloc(a, 2048) == a);
+    check(a, 2048);
+
+    // Growing takes over a free right neighbour in place
+    unsigned char *b = mallocing(2000);
+    unsigned char *c = mallocing(2000);
+    fill(b, 2000);
+    freeing(c);
+    assert(my_realloc(b, 3500) == b);
+    check(b, 2000);
+
+    // Zero size frees
+    assert(my_realloc(b, 0) == NULL);
+    freeing(a);
+    return 0;
+}
@@ -0,0 +1,62 @@
+#include "testing.h"
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+#define NOBJECTS 20000
+
+static unsigned char *objs[NOBJECTS];
+
+static size_t allocated(void)
+{
+    size_t value = 0;
+    assert(my_mallctl("allocated", &value) == 0);
+    return value;
+}
+
+// Fills a region with objects of mixed sizes, some far bigger than a chunk
+static void fill(my_region *region)
+{
+    for (int i = 0; i < NOBJECTS; i++)
+    {
+        size_t size = i % 1000 == 0 ? 100000 : 1 + i % 200;
+        objs[i] = my_region_alloc(region, size);
+        CHECK_NULL(objs[i]);
+        assert(((uintptr_t)objs[i] & (kAlignment - 1)) == 0);
+        memset(objs[i], i, size);
+    }
+    for (int i = 0; i < NOBJECTS; i++)
+    {
+        size_t size = i % 1000 == 0 ? 100000 : 1 + i % 200;
+        assert(objs[i][0] == (unsigned char)i && objs[i][size - 1] == (unsigned char)i);
+    }
+}
+
+int main()
+{
+    size_t before = allocated();
+    my_region *region = my_region_create();
+    CHECK_NULL(region);
+    fill(region);
+    assert(allocated() > before + NOBJECTS * 100);
+
+    // A reset keeps the first chunk, which hands out the same memory again
+    unsigned char *first = objs[0];
+    size_t grown = allocated();
+    my_region_reset(region);
+    assert(allocated() < grown);
+    fill(region);
+    assert(objs[0] == first);
+
+    // Objects sit back to back, with no headers between them
+    my_region_reset(region);
+    char *a = my_region_alloc(region, 24);
+    char *b = my_region_alloc(region, 24);
+    assert(b == a + 24);
+
+    assert(my_region_alloc(region, SIZE_MAX) == NULL && errno == ENOMEM);
+    my_region_destroy(region);
+    my_region_destroy(NULL);
+    assert(allocated() == before);
+    return 0;
+}
@@ -0,0 +1,71 @@
+#include "testing.h"
+#include <string.h>
+
+#define NALLOCS 256
+
+int main()
+{
+    // The rounding slack is reported and usable
+    size_t actual = 0;
+    char *ptr = my_malloc_at_least(100, &actual);
+    CHECK_NULL(ptr);
+    assert(actual >= 100 && actual == my_malloc_usable_size(ptr));
+    memset(ptr, 1, actual);
+    my_free_sized(ptr, actual);
+    assert(my_malloc_usable_size(NULL) == 0);
+
+    // Sized frees of every cached size, by the size asked for or the usable
+    // one, hand back objects that are reused without overlapping
+    static unsigned char *ptrs[NALLOCS];
+    for (size_t size = 1; size <= 3000; size += 13)
+    {
+        for (int i = 0; i < NALLOCS; i++)
+        {
+            ptrs[i] = mallocing(size);
+            assert(my_malloc_usable_size(ptrs[i]) >= size);
+            memset(ptrs[i], i, size);
+        }
+        for (int i = 0; i < NALLOCS; i++)
+        {
+            assert(ptrs[i][0] == (unsigned char)i && ptrs[i][size - 1] == (unsigned char)i);
+            my_free_sized(ptrs[i], i % 2 ? size : my_malloc_usable_size(ptrs[i]));
+        }
+    }
+
+    // Sized frees put objects back in their own class, so aligned requests
+    // served from slab classes stay aligned
+    for (size_t size = 16; size <= 256; size += 8)
+    {
+        for (size_t alignment = 16; alignment <= 64 && alignment <= size; alignment <<= 1)
+        {
+            for (int i = 0; i < NALLOCS; i++)
+                ptrs[i] = mallocing(size);
+            for (int i = 0; i < NALLOCS; i++)
+                my_free_sized(ptrs[i], size);
+            for (int i = 0; i < NALLOCS; i++)
+            {
+                ptrs[i] = my_memalign(alignment, alignment);
+                CHECK_NULL(ptrs[i]);
+                assert(((size_t)ptrs[i] & (alignment - 1)) == 0);
+                assert(my_malloc_usable_size(ptrs[i]) == alignment);
+            }
+            freeing_loop((void **)ptrs, NALLOCS);
+        }
+    }
+
+    // Nor does an aligned object freed by the size asked for turn up as a
+    // smaller one
+    ptr = my_memalign(64, 10);
+    CHECK_NULL(ptr);
+    my_free_sized(ptr, 10);
+    ptr = mallocing(16);
+    assert(my_malloc_usable_size(ptr) == 16);
+    freeing(ptr);
+
+    // A shrunk block is freed by its new size
+    ptr = mallocing(2000);
+    ptr = my_realloc(ptr, 100);
+    CHECK_NULL(ptr);
+    my_free_sized(ptr, 100);
+    return 0;
+}
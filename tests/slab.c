@@ -0,0 +1,39 @@
+#include "testing.h"
+#include <string.h>
+
+#define NALLOCS 1024
+#define PAGE 4096
+
+int main()
+{
+    // 8 byte objects have no boundary tags, so they pack into a few pages
+    void *ptrs[NALLOCS];
+    mallocing_loop(ptrs, 8, NALLOCS);
+    size_t pages[NALLOCS];
+    size_t npages = 0;
+    for (int i = 0; i < NALLOCS; i++)
+    {
+        size_t page = (size_t)ptrs[i] / PAGE;
+        size_t j = 0;
+        while (j < npages && pages[j] != page)
+            j++;
+        if (j == npages)
+            pages[npages++] = page;
+    }
+    assert(npages <= 3);
+    freeing_loop(ptrs, NALLOCS);
+
+    // Every size class hands out objects that don't overlap
+    for (size_t size = 1; size <= 256; size++)
+    {
+        unsigned char *a = mallocing(size);
+        unsigned char *b = mallocing(size);
+        memset(a, 0x11, size);
+        memset(b, 0x22, size);
+        for (size_t k = 0; k < size; k++)
+            assert(a[k] == 0x11 && b[k] == 0x22);
+        freeing(a);
+        freeing(b);
+    }
+    return 0;
+}
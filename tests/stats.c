@@ -0,0 +1,75 @@
+#include "testing.h"
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+
+#define NALLOCS 100
+
+// Counts of a thread that has exited stay in the totals
+static void *worker(void *arg)
+{
+    USE(arg);
+    for (int i = 0; i < NALLOCS; i++)
+        freeing(mallocing(500));
+    return NULL;
+}
+
+int main()
+{
+    size_t value;
+    assert(my_mallctl("no_such_stat", &value) == ENOENT);
+
+    // Every size kind is counted, and what is freed leaves "allocated"
+    size_t allocated = counter("allocated");
+    size_t nmalloc = counter("nmalloc");
+    size_t nfree = counter("nfree");
+    size_t sizes[] = {16, 200, 600, 3000, 100000, 2 << 20};
+    void *ptrs[sizeof(sizes) / sizeof(sizes[0])];
+    size_t usable = 0;
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+        ptrs[i] = mallocing(sizes[i]);
+        usable += my_malloc_usable_size(ptrs[i]);
+    }
+    assert(counter("allocated") == allocated + usable);
+    assert(counter("nmalloc") == nmalloc + sizeof(sizes) / sizeof(sizes[0]));
+    assert(counter("mapped_huge") >= (2 << 20));
+    assert(counter("mapped") >= counter("allocated"));
+    assert(counter("mmaps") > 0 && counter("searches") > 0 && counter("splits") > 0);
+    freeing_loop(ptrs, sizeof(sizes) / sizeof(sizes[0]));
+    assert(counter("allocated") == allocated);
+    assert(counter("nfree") == nfree + sizeof(sizes) / sizeof(sizes[0]));
+    assert(counter("mapped_huge") == 0);
+
+    // Large blocks freed next to each other coalesce
+    size_t coalesces = counter("coalesces");
+    void *large[NALLOCS];
+    mallocing_loop(large, 5000, NALLOCS);
+    freeing_loop(large, NALLOCS);
+    assert(counter("coalesces") > coalesces);
+
+    pthread_t thread;
+    nmalloc = counter("nmalloc");
+    pthread_create(&thread, NULL, worker, NULL);
+    pthread_join(thread, NULL);
+    assert(counter("nmalloc") == nmalloc + NALLOCS);
+    assert(counter("allocated") == allocated);
+
+    // The JSON report holds the same totals, and is cut like snprintf
+    char buf[8192];
+    size_t len = my_malloc_stats(buf, sizeof(buf));
+    assert(len < sizeof(buf) && len == strlen(buf));
+    assert(buf[0] == '{' && buf[len - 1] == '}');
+    assert(strstr(buf, "\"arenas\":[{") != NULL);
+    assert(strstr(buf, "\"bins\":[{\"kind\":\"slab\"") != NULL);
+    assert(strstr(buf, "\"kind\":\"huge\"") != NULL);
+    char expect[64];
+    snprintf(expect, sizeof(expect), "\"allocated\":%zu,", allocated);
+    assert(strstr(buf, expect) != NULL);
+
+    char small[16];
+    assert(my_malloc_stats(small, sizeof(small)) == len);
+    assert(strlen(small) == sizeof(small) - 1 && strncmp(small, buf, sizeof(small) - 1) == 0);
+    assert(my_malloc_stats(NULL, 0) == len);
+    return 0;
+}
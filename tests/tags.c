@@ -0,0 +1,46 @@
+#include "testing.h"
+#include <string.h>
+
+#define NALLOCS 300
+#define SIZE 2008
+
+static void *ptrs[NALLOCS];
+static size_t merged;
+
+static void findMerged(void *ptr, size_t size, int used, void *arg)
+{
+    USE(arg);
+    if (ptr == ptrs[0])
+        merged = used ? 0 : size;
+}
+
+int main()
+{
+    // Blocks in use carry a header and no footer, so a run of them is laid
+    // out one word apart
+    assert(my_malloc_batch(SIZE, NALLOCS, ptrs) == NALLOCS);
+    for (int i = 0; i < NALLOCS; i++)
+    {
+        assert(my_malloc_usable_size(ptrs[i]) == SIZE);
+        memset(ptrs[i], 0xff, SIZE);
+        if (i > 0)
+            assert((char *)ptrs[i] == (char *)ptrs[i - 1] + SIZE + sizeof(size_t));
+    }
+
+    // Freed out of order, every block still merges with both neighbours,
+    // whose tags the payloads in use overwrote nothing of
+    for (int i = 1; i < NALLOCS; i += 2)
+        freeing(ptrs[i]);
+    for (int i = 0; i < NALLOCS; i += 2)
+        freeing(ptrs[i]);
+    my_heap_walk(findMerged, NULL);
+    assert(merged >= NALLOCS * (SIZE + sizeof(size_t)) - sizeof(size_t));
+
+    // Memory handed out again is cleared where calloc promises it is
+    char *p = my_calloc(1, NALLOCS * SIZE);
+    CHECK_NULL(p);
+    for (size_t i = 0; i < NALLOCS * SIZE; i++)
+        assert(p[i] == 0);
+    freeing(p);
+    return 0;
+}
@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <sys/resource.h>
+#include <unistd.h>
 #include "../mymalloc.h"
 
 #define CHECK_NULL(x)                                                       \
@@ -50,3 +51,26 @@ static inline void freeing(void *ptr)
 {
     my_free(ptr);
 }
+
+// Bytes of the process resident in memory, from /proc/self/statm
+static inline size_t resident_bytes(void)
+{
+    size_t pages = 0, resident = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+    assert(f != NULL);
+    int read = fscanf(f, "%zu %zu", &pages, &resident);
+    assert(read == 2);
+    USE(read);
+    fclose(f);
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+// Value of the my_mallctl() counter "name", which must exist
+static inline size_t counter(const char *name)
+{
+    size_t value = 0;
+    int err = my_mallctl(name, &value);
+    assert(err == 0);
+    USE(err);
+    return value;
+}
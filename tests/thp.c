@@ -0,0 +1,51 @@
+#include "testing.h"
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#define SIZE (10 << 20)
+#define HUGE_PAGE (2 << 20)
+
+// Whether the mapping holding "ptr" is advised to use huge pages
+static int advised(void *ptr)
+{
+    FILE *smaps = fopen("/proc/self/smaps", "r");
+    assert(smaps != NULL);
+    char line[512];
+    int inside = 0, found = 0;
+    while (fgets(line, sizeof(line), smaps) != NULL)
+    {
+        uintptr_t start, end;
+        if (sscanf(line, "%lx-%lx ", &start, &end) == 2)
+            inside = (uintptr_t)ptr >= start && (uintptr_t)ptr < end;
+        else if (inside && strncmp(line, "VmFlags:", 8) == 0)
+            found = strstr(line, " hg") != NULL;
+    }
+    fclose(smaps);
+    return found;
+}
+
+int main()
+{
+    setenv("MYMALLOC_THP", "madvise", 1);
+    // Keep the block in a block chunk of the arena
+    setenv("MYMALLOC_MMAP_THRESHOLD", "67108864", 1);
+
+    char *p = mallocing(SIZE);
+    memset(p, 1, SIZE);
+    if (access("/sys/kernel/mm/transparent_hugepage/enabled", F_OK) == 0)
+        assert(advised(p));
+
+    // Free pages go back in whole huge pages only
+    size_t before = counter("purged");
+    freeing(p);
+    assert(my_malloc_trim() == 1);
+    size_t purged = counter("purged") - before;
+    assert(purged >= SIZE / 2 && purged % HUGE_PAGE == 0);
+
+    // Purged memory is handed out again, reading as zero
+    p = mallocing(SIZE);
+    assert(p[SIZE / 2] == 0);
+    freeing(p);
+    return 0;
+}
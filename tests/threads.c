@@ -0,0 +1,47 @@
+#include "testing.h"
+#include <pthread.h>
+#include <string.h>
+
+#define NTHREADS 8
+#define NALLOCS 500
+#define NLOOPS 20
+
+// Each thread fills its blocks with its own id, so any block handed out
+// twice or recycled while live shows up as a wrong byte
+static void *worker(void *arg)
+{
+    unsigned char id = (unsigned char)(size_t)arg;
+    void *ptrs[NALLOCS];
+    size_t sizes[NALLOCS];
+
+    for (int j = 0; j < NLOOPS; j++)
+    {
+        for (int i = 0; i < NALLOCS; i++)
+        {
+            sizes[i] = 1 + (i * 37 + j * 11) % 2000;
+            ptrs[i] = mallocing(sizes[i]);
+            memset(ptrs[i], id, sizes[i]);
+        }
+        for (int i = 0; i < NALLOCS; i++)
+        {
+            unsigned char *bytes = ptrs[i];
+            for (size_t k = 0; k < sizes[i]; k++)
+                assert(bytes[k] == id);
+            freeing(ptrs[i]);
+        }
+    }
+    return NULL;
+}
+
+int main()
+{
+    pthread_t threads[NTHREADS];
+    for (size_t t = 0; t < NTHREADS; t++)
+        pthread_create(&threads[t], NULL, worker, (void *)(t + 1));
+    for (int t = 0; t < NTHREADS; t++)
+        pthread_join(threads[t], NULL);
+
+    // Caches of exited threads were drained, so the heap is still usable
+    freeing(mallocing(8));
+    return 0;
+}
@@ -0,0 +1,89 @@
+#include "testing.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define NALLOCS 3000
+
+static my_trace_record records[4 * NALLOCS];
+
+static void *worker(void *arg)
+{
+    // Every block of this thread is freed by the main thread
+    void **ptrs = arg;
+    for (int i = 0; i < NALLOCS; i++)
+        ptrs[i] = mallocing(24);
+    return NULL;
+}
+
+// Traced in a child, the trace starts with the allocator
+static void run(void)
+{
+    static void *ptrs[NALLOCS];
+    pthread_t thread;
+    pthread_create(&thread, NULL, worker, ptrs);
+    pthread_join(thread, NULL);
+    for (int i = 0; i < NALLOCS; i++)
+        freeing(ptrs[i]);
+
+    void *p = my_calloc(10, 10);
+    p = my_realloc(p, 5000);
+    my_free_sized(p, 5000);
+    p = my_memalign(256, 100);
+    freeing(p);
+    exit(0);
+}
+
+int main()
+{
+    char path[64];
+    setenv("MYMALLOC_TRACE", "/tmp/mymalloc-trace.%p", 1);
+    pid_t pid = fork();
+    if (pid == 0)
+        run();
+    int status;
+    assert(waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    snprintf(path, sizeof(path), "/tmp/mymalloc-trace.%d", (int)pid);
+    int fd = open(path, O_RDONLY);
+    assert(fd >= 0);
+    my_trace_header header;
+    assert(read(fd, &header, sizeof(header)) == sizeof(header));
+    assert(memcmp(header.magic, MY_TRACE_MAGIC, 8) == 0 && header.version == MY_TRACE_VERSION);
+    ssize_t len = read(fd, records, sizeof(records));
+    close(fd);
+    unlink(path);
+    assert(len > 0 && len % sizeof(my_trace_record) == 0);
+    size_t n = len / sizeof(my_trace_record);
+
+    // Records of both threads, every call once, each thread in order
+    size_t counts[MY_TRACE_FREE + 1] = {0};
+    uint64_t last[2] = {0, 0};
+    for (size_t i = 0; i < n; i++)
+    {
+        assert(records[i].thread < 2 && records[i].ptr != 0);
+        assert(last[records[i].thread] == 0 || records[i].seq > last[records[i].thread]);
+        last[records[i].thread] = records[i].seq;
+        counts[records[i].op]++;
+        if (records[i].op == MY_TRACE_MEMALIGN)
+            assert(records[i].align == 8);
+    }
+    assert(counts[MY_TRACE_MALLOC] == NALLOCS && counts[MY_TRACE_FREE] == NALLOCS + 2);
+    assert(counts[MY_TRACE_CALLOC] == 1 && counts[MY_TRACE_MEMALIGN] == 1);
+    assert(counts[MY_TRACE_REALLOC_FROM] == 1 && counts[MY_TRACE_REALLOC] == 1);
+
+    // A block is allocated before it is freed, whichever thread frees it
+    for (size_t i = 0; i < n; i++)
+    {
+        if (records[i].op != MY_TRACE_FREE)
+            continue;
+        int found = 0;
+        for (size_t j = 0; j < n && !found; j++)
+            found = records[j].op != MY_TRACE_FREE && records[j].op != MY_TRACE_REALLOC_FROM &&
+                    records[j].ptr == records[i].ptr && records[j].seq < records[i].seq;
+        assert(found && (records[i].size == 0 || records[i].size == 5000));
+    }
+    return 0;
+}
@@ -0,0 +1,60 @@
+#include "testing.h"
+#include <string.h>
+
+#define NALLOCS 256
+#define SIZE (256 << 10)
+#define NSMALL (1 << 20)
+#define SMALL_SIZE 128
+
+static void *small[NSMALL];
+
+int main()
+{
+    size_t before = resident_bytes();
+
+    // A burst of large blocks, freed again: emptied chunks are purged
+    void *ptrs[NALLOCS];
+    for (int i = 0; i < NALLOCS; i++)
+    {
+        ptrs[i] = mallocing(SIZE);
+        memset(ptrs[i], 1, SIZE);
+    }
+    size_t peak = resident_bytes();
+    assert(peak >= before + NALLOCS * SIZE);
+    freeing_loop(ptrs, NALLOCS);
+    size_t after = resident_bytes();
+    assert(after < before + 8 * SIZE * 2);
+
+    // The chunk that is kept still holds dirty pages until a trim purges them
+    assert(my_malloc_trim() == 1);
+    assert(resident_bytes() < after);
+
+    // Purged memory is usable again
+    char *ptr = mallocing(SIZE);
+    memset(ptr, 2, SIZE);
+    freeing(ptr);
+
+    // A burst of slab objects, freed again: emptied slab chunks go back to
+    // the page heap, and a trim purges the runs of the one still carved
+    memset(small, 0, sizeof(small));
+    before = resident_bytes();
+    for (int i = 0; i < NSMALL; i++)
+    {
+        small[i] = mallocing(SMALL_SIZE);
+        memset(small[i], 1, SMALL_SIZE);
+    }
+    peak = resident_bytes();
+    assert(peak >= before + (size_t) NSMALL * SMALL_SIZE);
+    freeing_loop(small, NSMALL);
+    assert(my_malloc_trim() == 1);
+    assert(resident_bytes() < before + 8 * SIZE * 2);
+
+    // Purged runs take objects again
+    for (int i = 0; i < NSMALL; i++)
+    {
+        small[i] = mallocing(SMALL_SIZE);
+        memset(small[i], 2, SMALL_SIZE);
+    }
+    freeing_loop(small, NSMALL);
+    return 0;
+}
@@ -0,0 +1,72 @@
+#include "testing.h"
+#include <string.h>
+
+#define NALLOCS 300
+
+static void *ptrs[NALLOCS];
+static size_t sizes[NALLOCS];
+static int seen[NALLOCS];
+static size_t blocks;
+
+// Every live allocation shows up once, in use and big enough
+static void check(void *ptr, size_t size, int used, void *arg)
+{
+    USE(arg);
+    blocks++;
+    for (int i = 0; i < NALLOCS; i++)
+    {
+        if (ptrs[i] == ptr)
+        {
+            assert(used && size >= sizes[i]);
+            seen[i]++;
+        }
+    }
+}
+
+int main()
+{
+    for (int i = 0; i < NALLOCS; i++)
+    {
+        sizes[i] = (i % 3 == 0) ? 100 : (i % 3 == 1) ? 3000 : 50000;
+        if (i == NALLOCS - 1)
+            sizes[i] = 2 << 20;
+        ptrs[i] = mallocing(sizes[i]);
+        memset(ptrs[i], i, sizes[i]);
+    }
+
+    // Holes between live blocks are walked as free
+    for (int i = 0; i < NALLOCS; i += 4)
+    {
+        freeing(ptrs[i]);
+        ptrs[i] = NULL;
+    }
+    my_malloc_trim();
+
+    my_heap_walk(check, NULL);
+    assert(blocks > NALLOCS);
+    for (int i = 0; i < NALLOCS; i++)
+        assert(seen[i] == (ptrs[i] != NULL));
+
+    static char buf[1 << 16];
+    size_t len = my_heap_report(buf, sizeof(buf));
+    assert(len < sizeof(buf) && len == strlen(buf));
+    assert(strncmp(buf, "{\"arenas\":[{\"chunks\":[{\"kind\":", 30) == 0);
+    assert(strstr(buf, "\"kind\":\"huge\"") != NULL);
+    assert(strstr(buf, "\"lists\":[") != NULL && strstr(buf, "\"tree\":{") != NULL);
+
+    // Freed holes make the free space fragmented
+    char *frag = strstr(buf, "\"fragmentation\":");
+    assert(frag != NULL);
+    double ratio = strtod(frag + strlen("\"fragmentation\":"), NULL);
+    assert(ratio > 0.0 && ratio < 1.0);
+    char *map = strstr(buf, "\"map\":\"");
+    assert(map != NULL && strchr(map + 7, '"') - (map + 7) == 64);
+
+    char small[8];
+    assert(my_heap_report(small, sizeof(small)) == len);
+    assert(strlen(small) == sizeof(small) - 1);
+
+    for (int i = 0; i < NALLOCS; i++)
+        my_free(ptrs[i]);
+    return 0;
+}